@@ -666,7 +666,11 @@ static bool drm_connector_state_update_primary_fb(struct wlr_drm_connector *conn
 			return false;
 		}
 
-		local_buf = drm_surface_blit(&plane->mgpu_surf, source_buf);
+		const pixman_region32_t *damage = NULL;
+		if (state->base->committed & WLR_OUTPUT_STATE_DAMAGE) {
+			damage = &state->base->damage;
+		}
+		local_buf = drm_surface_blit(&plane->mgpu_surf, source_buf, damage);
 		if (local_buf == NULL) {
 			return false;
 		}
@@ -1048,7 +1052,7 @@ static bool drm_connector_set_cursor(struct wlr_output *output,
 				return false;
 			}
 
-			local_buf = drm_surface_blit(&plane->mgpu_surf, buffer);
+			local_buf = drm_surface_blit(&plane->mgpu_surf, buffer, NULL);
 			if (local_buf == NULL) {
 				return false;
 			}
@@ -1197,6 +1201,14 @@ uint32_t wlr_drm_connector_get_id(struct wlr_output *output) {
 	return conn->id;
 }
 
+uint64_t wlr_drm_connector_get_mgpu_copied_pixels(struct wlr_output *output) {
+	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
+	if (!conn->backend->parent || conn->crtc == NULL) {
+		return 0;
+	}
+	return conn->crtc->primary->mgpu_surf.copied_pixels;
+}
+
 enum wl_output_transform wlr_drm_connector_get_panel_orientation(
 		struct wlr_output *output) {
 	struct wlr_drm_connector *conn = get_drm_connector_from_output(output);
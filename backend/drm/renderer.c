@@ -47,6 +47,7 @@ void finish_drm_surface(struct wlr_drm_surface *surf) {
 	}
 
 	wlr_swapchain_destroy(surf->swapchain);
+	wlr_damage_ring_finish(&surf->damage_ring);
 
 	*surf = (struct wlr_drm_surface){0};
 }
@@ -69,12 +70,14 @@ bool init_drm_surface(struct wlr_drm_surface *surf,
 	}
 
 	surf->renderer = renderer;
+	wlr_damage_ring_init(&surf->damage_ring);
+	wlr_damage_ring_set_bounds(&surf->damage_ring, width, height);
 
 	return true;
 }
 
 struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
-		struct wlr_buffer *buffer) {
+		struct wlr_buffer *buffer, const pixman_region32_t *damage) {
 	struct wlr_renderer *renderer = surf->renderer->wlr_rend;
 
 	if (surf->swapchain->width != buffer->width ||
@@ -95,6 +98,18 @@ struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
 		goto error_tex;
 	}
 
+	if (damage != NULL) {
+		wlr_damage_ring_add(&surf->damage_ring, damage);
+	} else {
+		wlr_damage_ring_add_whole(&surf->damage_ring);
+	}
+
+	// Only copy the regions which changed since the destination buffer was
+	// last blitted to
+	pixman_region32_t copy_damage;
+	pixman_region32_init(&copy_damage);
+	wlr_damage_ring_rotate_buffer(&surf->damage_ring, dst, &copy_damage);
+
 	struct wlr_render_pass *pass = wlr_renderer_begin_buffer_pass(renderer, dst, NULL);
 	if (pass == NULL) {
 		wlr_log(WLR_ERROR, "Failed to begin render pass with multi-GPU destination buffer");
@@ -103,6 +118,7 @@ struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
 
 	wlr_render_pass_add_texture(pass, &(struct wlr_render_texture_options){
 		.texture = tex,
+		.clip = &copy_damage,
 		.blend_mode = WLR_RENDER_BLEND_MODE_NONE,
 	});
 	if (!wlr_render_pass_submit(pass)) {
@@ -110,11 +126,23 @@ struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
 		goto error_dst;
 	}
 
+	surf->copied_pixels = 0;
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&copy_damage, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		surf->copied_pixels += (uint64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+
+	pixman_region32_fini(&copy_damage);
 	wlr_texture_destroy(tex);
 
 	return dst;
 
 error_dst:
+	// The destination buffer contents are now undefined
+	wlr_damage_ring_add_whole(&surf->damage_ring);
+	pixman_region32_fini(&copy_damage);
 	wlr_buffer_unlock(dst);
 error_tex:
 	wlr_texture_destroy(tex);
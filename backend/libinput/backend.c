@@ -56,9 +56,17 @@ static int handle_libinput_readable(int fd, uint32_t mask, void *_backend) {
 	}
 	struct libinput_event *event;
 	while ((event = libinput_get_event(backend->libinput_context))) {
-		handle_libinput_event(backend, event);
+		if (backend->coalesce_motion && libinput_event_get_type(event) ==
+				LIBINPUT_EVENT_POINTER_MOTION) {
+			coalesce_pointer_motion(backend, event);
+		} else {
+			// Keep events ordered
+			flush_pointer_motion(backend);
+			handle_libinput_event(backend, event);
+		}
 		libinput_event_destroy(event);
 	}
+	flush_pointer_motion(backend);
 	return 0;
 }
 
@@ -194,6 +202,7 @@ struct wlr_backend *wlr_libinput_backend_create(struct wlr_session *session) {
 	wl_list_init(&backend->devices);
 
 	backend->session = session;
+	backend->coalesce_motion = env_parse_bool("WLR_LIBINPUT_COALESCE_MOTION");
 
 	backend->session_signal.notify = session_signal;
 	wl_signal_add(&session->events.active, &backend->session_signal);
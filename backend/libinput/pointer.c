@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <libinput.h>
 #include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/util/log.h>
 #include "backend/libinput.h"
 
 const struct wlr_pointer_impl libinput_pointer_impl = {
@@ -38,6 +39,47 @@ void handle_pointer_motion(struct libinput_event *event,
 	wl_signal_emit_mutable(&pointer->events.frame, pointer);
 }
 
+void coalesce_pointer_motion(struct wlr_libinput_backend *backend,
+		struct libinput_event *event) {
+	struct wlr_libinput_input_device *dev =
+		libinput_device_get_user_data(libinput_event_get_device(event));
+	if (dev == NULL) {
+		wlr_log(WLR_ERROR, "libinput_device has no wlr_libinput_input_device");
+		return;
+	}
+
+	struct wlr_pointer_motion_event *pending = &backend->pending_motion;
+	if (pending->pointer != NULL && pending->pointer != &dev->pointer) {
+		flush_pointer_motion(backend);
+	}
+
+	struct libinput_event_pointer *pevent =
+		libinput_event_get_pointer_event(event);
+	if (pending->pointer == NULL) {
+		*pending = (struct wlr_pointer_motion_event){
+			.pointer = &dev->pointer,
+		};
+	}
+	pending->time_msec =
+		usec_to_msec(libinput_event_pointer_get_time_usec(pevent));
+	pending->delta_x += libinput_event_pointer_get_dx(pevent);
+	pending->delta_y += libinput_event_pointer_get_dy(pevent);
+	pending->unaccel_dx += libinput_event_pointer_get_dx_unaccelerated(pevent);
+	pending->unaccel_dy += libinput_event_pointer_get_dy_unaccelerated(pevent);
+}
+
+void flush_pointer_motion(struct wlr_libinput_backend *backend) {
+	struct wlr_pointer_motion_event wlr_event = backend->pending_motion;
+	if (wlr_event.pointer == NULL) {
+		return;
+	}
+	backend->pending_motion.pointer = NULL;
+
+	struct wlr_pointer *pointer = wlr_event.pointer;
+	wl_signal_emit_mutable(&pointer->events.motion, &wlr_event);
+	wl_signal_emit_mutable(&pointer->events.frame, pointer);
+}
+
 void handle_pointer_motion_abs(struct libinput_event *event,
 		struct wlr_pointer *pointer) {
 	struct libinput_event_pointer *pevent =
@@ -19,6 +19,8 @@
 #include "render/pixel_format.h"
 #include "render/wlr_renderer.h"
 #include "types/wlr_output.h"
+#include "util/env.h"
+#include "util/time.h"
 
 #include "linux-dmabuf-v1-client-protocol.h"
 #include "presentation-time-client-protocol.h"
@@ -34,6 +36,8 @@ static const uint32_t SUPPORTED_OUTPUT_STATE =
 	WLR_OUTPUT_STATE_MODE |
 	WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED;
 
+static const size_t max_frames_in_flight = 2;
+
 static size_t last_output_num = 0;
 
 static const char *surface_tag = "wlr_wl_output";
@@ -70,6 +74,11 @@ static void surface_frame_callback(void *data, struct wl_callback *cb,
 	wl_callback_destroy(cb);
 	output->frame_callback = NULL;
 
+	// In pipelined mode, the frame timer may have already sent the frame
+	if (output->pipelined && !output->wlr_output.frame_pending) {
+		return;
+	}
+
 	wlr_output_send_frame(&output->wlr_output);
 }
 
@@ -77,8 +86,48 @@ static const struct wl_callback_listener frame_listener = {
 	.done = surface_frame_callback
 };
 
+static int handle_frame_timer(void *data) {
+	struct wlr_wl_output *output = data;
+	if (output->wlr_output.frame_pending &&
+			output->frames_in_flight < max_frames_in_flight) {
+		wlr_output_send_frame(&output->wlr_output);
+	}
+	return 0;
+}
+
+static void schedule_pipelined_frame(struct wlr_wl_output *output) {
+	if (!output->pipelined || output->frame_timer == NULL ||
+			output->refresh_nsec == 0 || output->last_presented_nsec == 0 ||
+			output->frames_in_flight >= max_frames_in_flight) {
+		// Wait for the frame callback
+		return;
+	}
+
+	// Send the next frame event at the next predicted vblank of the parent
+	// compositor, without waiting for the round-trip of the frame callback
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t now_nsec = timespec_to_nsec(&now);
+	int64_t refresh = output->refresh_nsec;
+	int64_t elapsed = now_nsec - output->last_presented_nsec;
+	int64_t next = output->last_presented_nsec;
+	if (elapsed > 0) {
+		next += (elapsed / refresh + 1) * refresh;
+	}
+
+	int delay_ms = (next - now_nsec + 999999) / 1000000;
+	if (delay_ms < 1) {
+		// A zero delay would disarm the timer
+		delay_ms = 1;
+	}
+	wl_event_source_timer_update(output->frame_timer, delay_ms);
+}
+
 static void presentation_feedback_destroy(
 		struct wlr_wl_presentation_feedback *feedback) {
+	struct wlr_wl_output *output = feedback->output;
+	assert(output->frames_in_flight > 0);
+	output->frames_in_flight--;
 	wl_list_remove(&feedback->link);
 	wp_presentation_feedback_destroy(feedback->feedback);
 	free(feedback);
@@ -107,9 +156,22 @@ static void presentation_feedback_handle_presented(void *data,
 		.refresh = refresh_ns,
 		.flags = flags,
 	};
-	wlr_output_send_present(&feedback->output->wlr_output, &event);
+
+	struct wlr_wl_output *output = feedback->output;
+	int64_t presented_nsec = timespec_to_nsec(&t);
+	int64_t latency = presented_nsec - timespec_to_nsec(&feedback->committed);
+	output->stats.frames_presented++;
+	output->stats.last_latency_nsec = latency;
+	if (latency > output->stats.max_latency_nsec) {
+		output->stats.max_latency_nsec = latency;
+	}
+	output->last_presented_nsec = presented_nsec;
+	output->refresh_nsec = refresh_ns;
+
+	wlr_output_send_present(&output->wlr_output, &event);
 
 	presentation_feedback_destroy(feedback);
+	schedule_pipelined_frame(output);
 }
 
 static void presentation_feedback_handle_discarded(void *data,
@@ -120,9 +182,14 @@ static void presentation_feedback_handle_discarded(void *data,
 		.commit_seq = feedback->commit_seq,
 		.presented = false,
 	};
-	wlr_output_send_present(&feedback->output->wlr_output, &event);
+
+	struct wlr_wl_output *output = feedback->output;
+	output->stats.frames_discarded++;
+
+	wlr_output_send_present(&output->wlr_output, &event);
 
 	presentation_feedback_destroy(feedback);
+	schedule_pipelined_frame(output);
 }
 
 static const struct wp_presentation_feedback_listener
@@ -246,8 +313,9 @@ static struct wlr_wl_buffer *create_wl_buffer(struct wlr_wl_backend *wl,
 	return buffer;
 }
 
-static struct wlr_wl_buffer *get_or_create_wl_buffer(struct wlr_wl_backend *wl,
-		struct wlr_buffer *wlr_buffer) {
+static struct wlr_wl_buffer *get_or_create_wl_buffer(
+		struct wlr_wl_output *output, struct wlr_buffer *wlr_buffer) {
+	struct wlr_wl_backend *wl = output->backend;
 	struct wlr_wl_buffer *buffer;
 	wl_list_for_each(buffer, &wl->buffers, link) {
 		// We can only re-use a wlr_wl_buffer if the parent compositor has
@@ -256,10 +324,12 @@ static struct wlr_wl_buffer *get_or_create_wl_buffer(struct wlr_wl_backend *wl,
 		if (buffer->buffer == wlr_buffer && buffer->released) {
 			buffer->released = false;
 			wlr_buffer_lock(buffer->buffer);
+			output->stats.import_hits++;
 			return buffer;
 		}
 	}
 
+	output->stats.import_misses++;
 	return create_wl_buffer(wl, wlr_buffer);
 }
 
@@ -450,7 +520,7 @@ static bool output_layer_commit(struct wlr_wl_output *output,
 	}
 
 	struct wlr_wl_buffer *buffer =
-		get_or_create_wl_buffer(output->backend, state->buffer);
+		get_or_create_wl_buffer(output, state->buffer);
 	if (buffer == NULL) {
 		return false;
 	}
@@ -543,7 +613,7 @@ static bool output_commit(struct wlr_output *wlr_output,
 
 		struct wlr_buffer *wlr_buffer = state->buffer;
 		struct wlr_wl_buffer *buffer =
-			get_or_create_wl_buffer(output->backend, wlr_buffer);
+			get_or_create_wl_buffer(output, wlr_buffer);
 		if (buffer == NULL) {
 			return false;
 		}
@@ -582,7 +652,9 @@ static bool output_commit(struct wlr_output *wlr_output,
 			feedback->output = output;
 			feedback->feedback = wp_feedback;
 			feedback->commit_seq = output->wlr_output.commit_seq + 1;
+			clock_gettime(CLOCK_MONOTONIC, &feedback->committed);
 			wl_list_insert(&output->presentation_feedbacks, &feedback->link);
+			output->frames_in_flight++;
 
 			wp_presentation_feedback_add_listener(wp_feedback,
 				&presentation_feedback_listener, feedback);
@@ -593,6 +665,8 @@ static bool output_commit(struct wlr_output *wlr_output,
 			};
 			output_defer_present(wlr_output, present_event);
 		}
+
+		schedule_pipelined_frame(output);
 	}
 
 	wl_display_flush(output->backend->remote_display);
@@ -616,7 +690,7 @@ static bool output_set_cursor(struct wlr_output *wlr_output,
 
 	if (wlr_buffer != NULL) {
 		struct wlr_wl_buffer *buffer =
-			get_or_create_wl_buffer(output->backend, wlr_buffer);
+			get_or_create_wl_buffer(output, wlr_buffer);
 		if (buffer == NULL) {
 			return false;
 		}
@@ -660,6 +734,9 @@ static void output_destroy(struct wlr_output *wlr_output) {
 	if (output->frame_callback) {
 		wl_callback_destroy(output->frame_callback);
 	}
+	if (output->frame_timer != NULL) {
+		wl_event_source_remove(output->frame_timer);
+	}
 
 	struct wlr_wl_presentation_feedback *feedback, *feedback_tmp;
 	wl_list_for_each_safe(feedback, feedback_tmp,
@@ -793,6 +870,13 @@ static struct wlr_wl_output *output_create(struct wlr_wl_backend *backend,
 	output->backend = backend;
 	wl_list_init(&output->presentation_feedbacks);
 
+	output->frame_timer = wl_event_loop_add_timer(backend->event_loop,
+		handle_frame_timer, output);
+	if (output->frame_timer == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create frame timer");
+	}
+	output->pipelined = env_parse_bool("WLR_WL_PIPELINED");
+
 	wl_proxy_set_tag((struct wl_proxy *)output->surface, &surface_tag);
 	wl_surface_set_user_data(output->surface, output);
 
@@ -930,3 +1014,18 @@ struct wl_surface *wlr_wl_output_get_surface(struct wlr_output *output) {
 	struct wlr_wl_output *wl_output = get_wl_output_from_output(output);
 	return wl_output->surface;
 }
+
+void wlr_wl_output_set_pipelined(struct wlr_output *output, bool pipelined) {
+	struct wlr_wl_output *wl_output = get_wl_output_from_output(output);
+	wl_output->pipelined = pipelined;
+	if (!pipelined && wl_output->frame_timer != NULL) {
+		wl_event_source_timer_update(wl_output->frame_timer, 0);
+	}
+}
+
+void wlr_wl_output_get_stats(struct wlr_output *output,
+		struct wlr_wl_output_stats *stats) {
+	struct wlr_wl_output *wl_output = get_wl_output_from_output(output);
+	*stats = wl_output->stats;
+	stats->frames_in_flight = wl_output->frames_in_flight;
+}
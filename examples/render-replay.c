@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/recorder.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/util/log.h>
+
+/* Re-executes a render recording made with struct wlr_render_recorder, and
+ * prints how long each frame took.
+ *
+ * The renderer can be picked with WLR_RENDERER, e.g. to compare pixman with
+ * gles2 or vulkan on the same workload. */
+
+struct replay_stats {
+	size_t frames;
+	int64_t cpu_total_ns, cpu_max_ns;
+	int64_t gpu_total_ns, gpu_max_ns;
+	size_t gpu_frames;
+};
+
+static void handle_frame_done(const struct wlr_render_replay_frame *frame,
+		void *data) {
+	struct replay_stats *stats = data;
+
+	printf("frame %zu: %dx%d, %zu ops, cpu %.3f ms", frame->index,
+		frame->width, frame->height, frame->ops,
+		frame->cpu_duration_ns / 1e6);
+	if (frame->gpu_duration_ns >= 0) {
+		printf(", gpu %.3f ms", frame->gpu_duration_ns / 1e6);
+	}
+	printf("\n");
+
+	stats->frames++;
+	stats->cpu_total_ns += frame->cpu_duration_ns;
+	if (frame->cpu_duration_ns > stats->cpu_max_ns) {
+		stats->cpu_max_ns = frame->cpu_duration_ns;
+	}
+	if (frame->gpu_duration_ns >= 0) {
+		stats->gpu_frames++;
+		stats->gpu_total_ns += frame->gpu_duration_ns;
+		if (frame->gpu_duration_ns > stats->gpu_max_ns) {
+			stats->gpu_max_ns = frame->gpu_duration_ns;
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <recording>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	wlr_log_init(WLR_INFO, NULL);
+
+	FILE *f = fopen(argv[1], "rb");
+	if (f == NULL) {
+		perror("fopen");
+		return EXIT_FAILURE;
+	}
+
+	int ret = EXIT_FAILURE;
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct wlr_backend *backend = wlr_headless_backend_create(loop);
+	if (backend == NULL) {
+		goto out_loop;
+	}
+	struct wlr_renderer *renderer = wlr_renderer_autocreate(backend);
+	if (renderer == NULL) {
+		goto out_backend;
+	}
+	struct wlr_allocator *allocator =
+		wlr_allocator_autocreate(backend, renderer);
+	if (allocator == NULL) {
+		goto out_renderer;
+	}
+
+	struct replay_stats stats = {0};
+	if (wlr_render_recording_replay(f, renderer, allocator,
+			handle_frame_done, &stats)) {
+		ret = EXIT_SUCCESS;
+	}
+
+	if (stats.frames > 0) {
+		printf("%zu frames, cpu avg %.3f ms max %.3f ms\n", stats.frames,
+			stats.cpu_total_ns / 1e6 / stats.frames, stats.cpu_max_ns / 1e6);
+	}
+	if (stats.gpu_frames > 0) {
+		printf("gpu avg %.3f ms max %.3f ms\n",
+			stats.gpu_total_ns / 1e6 / stats.gpu_frames,
+			stats.gpu_max_ns / 1e6);
+	}
+
+	wlr_allocator_destroy(allocator);
+out_renderer:
+	wlr_renderer_destroy(renderer);
+out_backend:
+	wlr_backend_destroy(backend);
+out_loop:
+	wl_event_loop_destroy(loop);
+	fclose(f);
+	return ret;
+}
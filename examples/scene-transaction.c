@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+
+/* Checks that scene transactions damage nodes which are disabled, then
+ * re-enabled in a later transaction, as happens when switching workspaces.
+ *
+ * Exits with a non-zero status if a step doesn't damage the output. */
+
+static const float color[4] = { 1.0, 0.0, 0.0, 1.0 };
+
+static bool check_damage(struct wlr_scene_output *scene_output,
+		const char *step) {
+	struct wlr_damage_ring *ring = &scene_output->damage_ring;
+	bool ok = pixman_region32_contains_rectangle(&ring->current,
+		&(pixman_box32_t){ 10, 10, 110, 110 }) == PIXMAN_REGION_IN;
+	printf("%s: %s\n", step, ok ? "damaged" : "NOT damaged");
+	wlr_damage_ring_rotate(ring);
+	return ok;
+}
+
+int main(void) {
+	wlr_log_init(WLR_INFO, NULL);
+
+	int ret = EXIT_FAILURE;
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct wlr_backend *backend = wlr_headless_backend_create(loop);
+	if (backend == NULL) {
+		goto out_loop;
+	}
+	struct wlr_renderer *renderer = wlr_renderer_autocreate(backend);
+	if (renderer == NULL) {
+		goto out_backend;
+	}
+	struct wlr_allocator *allocator =
+		wlr_allocator_autocreate(backend, renderer);
+	if (allocator == NULL) {
+		goto out_renderer;
+	}
+	if (!wlr_backend_start(backend)) {
+		goto out_allocator;
+	}
+
+	struct wlr_output *output = wlr_headless_add_output(backend, 640, 480);
+	if (output == NULL) {
+		goto out_allocator;
+	}
+	wlr_output_init_render(output, allocator, renderer);
+
+	struct wlr_output_state state;
+	wlr_output_state_init(&state);
+	wlr_output_state_set_enabled(&state, true);
+	bool committed = wlr_output_commit_state(output, &state);
+	wlr_output_state_finish(&state);
+	if (!committed) {
+		goto out_allocator;
+	}
+
+	struct wlr_scene *scene = wlr_scene_create();
+	struct wlr_scene_output *scene_output =
+		wlr_scene_output_create(scene, output);
+	struct wlr_scene_tree *workspace = wlr_scene_tree_create(&scene->tree);
+	struct wlr_scene_rect *rect =
+		wlr_scene_rect_create(workspace, 100, 100, color);
+	wlr_scene_node_set_position(&rect->node, 10, 10);
+	wlr_damage_ring_rotate(&scene_output->damage_ring);
+
+	bool ok = true;
+
+	wlr_scene_transaction_begin(scene);
+	wlr_scene_node_set_enabled(&workspace->node, false);
+	wlr_scene_transaction_commit(scene);
+	ok = check_damage(scene_output, "disable") && ok;
+
+	wlr_scene_transaction_begin(scene);
+	wlr_scene_node_set_enabled(&workspace->node, true);
+	wlr_scene_transaction_commit(scene);
+	ok = check_damage(scene_output, "re-enable") && ok;
+
+	wlr_scene_transaction_begin(scene);
+	wlr_scene_node_set_enabled(&workspace->node, false);
+	wlr_scene_transaction_commit(scene);
+	ok = check_damage(scene_output, "disable again") && ok;
+
+	// Without a transaction
+	wlr_scene_node_set_enabled(&workspace->node, true);
+	ok = check_damage(scene_output, "re-enable without transaction") && ok;
+
+	if (ok) {
+		ret = EXIT_SUCCESS;
+	}
+
+	wlr_scene_node_destroy(&scene->tree.node);
+out_allocator:
+	wlr_allocator_destroy(allocator);
+out_renderer:
+	wlr_renderer_destroy(renderer);
+out_backend:
+	wlr_backend_destroy(backend);
+out_loop:
+	wl_event_loop_destroy(loop);
+	return ret;
+}
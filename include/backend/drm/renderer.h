@@ -4,7 +4,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <wlr/backend.h>
+#include <pixman.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_damage_ring.h>
 #include <wlr/util/addon.h>
 
 struct wlr_drm_backend;
@@ -20,6 +22,9 @@ struct wlr_drm_renderer {
 struct wlr_drm_surface {
 	struct wlr_drm_renderer *renderer;
 	struct wlr_swapchain *swapchain;
+	struct wlr_damage_ring damage_ring;
+	// Number of pixels copied by the last blit
+	uint64_t copied_pixels;
 };
 
 bool init_drm_renderer(struct wlr_drm_backend *drm,
@@ -31,8 +36,13 @@ bool init_drm_surface(struct wlr_drm_surface *surf,
 	const struct wlr_drm_format *drm_format);
 void finish_drm_surface(struct wlr_drm_surface *surf);
 
+/**
+ * Copy a buffer from the primary GPU to a buffer of the surface's swapchain.
+ * If damage is NULL, the whole buffer is assumed to have changed since the
+ * previous blit.
+ */
 struct wlr_buffer *drm_surface_blit(struct wlr_drm_surface *surf,
-	struct wlr_buffer *buffer);
+	struct wlr_buffer *buffer, const pixman_region32_t *damage);
 
 bool drm_plane_pick_render_format(struct wlr_drm_plane *plane,
 	struct wlr_drm_format *fmt, struct wlr_drm_renderer *renderer);
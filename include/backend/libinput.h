@@ -26,6 +26,11 @@ struct wlr_libinput_backend {
 	struct wl_listener session_signal;
 
 	struct wl_list devices; // wlr_libinput_device.link
+
+	bool coalesce_motion;
+	// Relative motion accumulated while draining the libinput queue, the
+	// pointer is NULL if there is none
+	struct wlr_pointer_motion_event pending_motion;
 };
 
 struct wlr_libinput_input_device {
@@ -65,6 +70,9 @@ void init_device_pointer(struct wlr_libinput_input_device *dev);
 struct wlr_libinput_input_device *device_from_pointer(struct wlr_pointer *kb);
 void handle_pointer_motion(struct libinput_event *event,
 	struct wlr_pointer *pointer);
+void coalesce_pointer_motion(struct wlr_libinput_backend *backend,
+	struct libinput_event *event);
+void flush_pointer_motion(struct wlr_libinput_backend *backend);
 void handle_pointer_motion_abs(struct libinput_event *event,
 	struct wlr_pointer *pointer);
 void handle_pointer_button(struct libinput_event *event,
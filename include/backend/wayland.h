@@ -2,6 +2,7 @@
 #define BACKEND_WAYLAND_H
 
 #include <stdbool.h>
+#include <time.h>
 
 #include <wayland-client.h>
 #include <wayland-server-core.h>
@@ -65,6 +66,7 @@ struct wlr_wl_presentation_feedback {
 	struct wl_list link;
 	struct wp_presentation_feedback *feedback;
 	uint32_t commit_seq;
+	struct timespec committed;
 };
 
 struct wlr_wl_output_layer {
@@ -90,6 +92,14 @@ struct wlr_wl_output {
 	struct zxdg_toplevel_decoration_v1 *zxdg_toplevel_decoration_v1;
 	struct wl_list presentation_feedbacks;
 
+	// Keep up to two frames in flight, see wlr_wl_output_set_pipelined()
+	bool pipelined;
+	struct wl_event_source *frame_timer;
+	size_t frames_in_flight; // commits waiting for presentation feedback
+	int64_t last_presented_nsec;
+	uint32_t refresh_nsec;
+	struct wlr_wl_output_stats stats;
+
 	bool configured;
 	uint32_t enter_serial;
 
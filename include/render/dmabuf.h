@@ -32,4 +32,13 @@ bool dmabuf_import_sync_file(int dmabuf_fd, uint32_t flags, int sync_file_fd);
  */
 int dmabuf_export_sync_file(int dmabuf_fd, uint32_t flags);
 
+/**
+ * Wrap a range of a memfd into a DMA-BUF via udmabuf.
+ *
+ * The memfd must be sealed against shrinking, the offset and size must be
+ * page-aligned. The DMA-BUF FD is returned on success, -1 is returned on
+ * error.
+ */
+int dmabuf_create_from_memfd(int memfd, uint64_t offset, uint64_t size);
+
 #endif
@@ -221,8 +221,6 @@ struct wlr_vk_command_buffer {
 	uint64_t timeline_point;
 	// Textures to destroy after the command buffer completes
 	struct wl_list destroy_textures; // wlr_vk_texture.destroy_link
-	// Staging shared buffers to release after the command buffer completes
-	struct wl_list stage_buffers; // wlr_vk_shared_buffer.link
 
 	// For DMA-BUF implicit sync interop, may be NULL
 	VkSemaphore binary_semaphore;
@@ -245,6 +243,11 @@ struct wlr_vk_renderer {
 
 	struct wl_list pipeline_layouts; // struct wlr_vk_pipeline_layout.link
 
+	// Persistent pipeline cache, VK_NULL_HANDLE if disabled
+	VkPipelineCache pipeline_cache;
+	char *pipeline_cache_path; // NULL if the cache isn't saved to disk
+	bool pipeline_cache_dirty;
+
 	// for blend->output subpass
 	VkPipelineLayout output_pipe_layout;
 	VkDescriptorSetLayout output_ds_layout;
@@ -271,6 +274,7 @@ struct wlr_vk_renderer {
 	struct {
 		struct wlr_vk_command_buffer *cb;
 		uint64_t last_timeline_point;
+		// Current ring first, followed by retiring and dedicated buffers
 		struct wl_list buffers; // wlr_vk_shared_buffer.link
 	} stage;
 
@@ -309,6 +313,14 @@ struct wlr_vk_texture_view *vulkan_texture_get_or_create_view(
 	struct wlr_vk_texture *texture,
 	const struct wlr_vk_pipeline_layout *layout);
 
+// Loads the pipeline cache from disk, or creates an empty one. Leaves
+// renderer->pipeline_cache to VK_NULL_HANDLE on failure.
+void vulkan_pipeline_cache_init(struct wlr_vk_renderer *renderer);
+// Writes the pipeline cache to disk if new pipelines were created since the
+// last save.
+void vulkan_pipeline_cache_save(struct wlr_vk_renderer *renderer);
+void vulkan_pipeline_cache_finish(struct wlr_vk_renderer *renderer);
+
 // Creates a vulkan renderer for the given device.
 struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev);
 
@@ -335,13 +347,20 @@ struct wlr_vk_render_pass {
 struct wlr_vk_render_pass *vulkan_begin_render_pass(struct wlr_vk_renderer *renderer,
 	struct wlr_vk_render_buffer *buffer);
 
-// Suballocates a buffer span with the given size that can be mapped
-// and used as staging buffer. The allocation is implicitly released when the
+// Suballocates a buffer span with the given size from the persistently
+// mapped staging ring. The allocation is implicitly released when the
 // stage cb has finished execution. The start of the span will be a multiple
 // of the given alignment.
 struct wlr_vk_buffer_span vulkan_get_stage_span(
 	struct wlr_vk_renderer *renderer, VkDeviceSize size,
 	VkDeviceSize alignment);
+// Associates all staging allocations made since the last call with the
+// submission signalling the given timeline point.
+void vulkan_stage_mark_submitted(struct wlr_vk_renderer *renderer,
+	uint64_t timeline_point);
+// Releases staging allocations of submissions which have completed.
+void vulkan_stage_retire(struct wlr_vk_renderer *renderer,
+	uint64_t current_point);
 
 // Tries to allocate a texture descriptor set. Will additionally
 // return the pool it was allocated from when successful (for freeing it later).
@@ -428,14 +447,29 @@ struct wlr_vk_allocation {
 	VkDeviceSize size;
 };
 
-// List of suballocated staging buffers.
+// Ring head position after a stage submission. Once the submission's
+// timeline point has been reached, the ring tail can advance to it.
+struct wlr_vk_stage_watermark {
+	uint64_t timeline_point;
+	VkDeviceSize head;
+};
+
+// Persistently mapped staging ring buffer.
 // Used to upload to/read from device local images.
 struct wlr_vk_shared_buffer {
-	struct wl_list link; // wlr_vk_renderer.stage.buffers or wlr_vk_command_buffer.stage_buffers
+	struct wl_list link; // wlr_vk_renderer.stage.buffers
 	VkBuffer buffer;
 	VkDeviceMemory memory;
 	VkDeviceSize buf_size;
-	struct wl_array allocs; // struct wlr_vk_allocation
+	void *cpu_mapping;
+	// One-off buffer for an allocation larger than the maximum ring size
+	bool dedicated;
+
+	// [tail, head) is in use, wrapping around if head < tail
+	VkDeviceSize head, tail;
+	// Whether allocations were made since the last stage submission
+	bool pending;
+	struct wl_array watermarks; // struct wlr_vk_stage_watermark
 };
 
 // Suballocated range on a buffer.
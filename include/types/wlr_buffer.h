@@ -74,4 +74,59 @@ struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 	struct wlr_buffer *next, const pixman_region32_t *damage);
 
+#define CLIENT_BUFFER_HISTORY_LEN 4
+
+/**
+ * History of the damage applied to a surface's client buffers. This allows
+ * recycled textures which hold recent contents of the surface to be brought
+ * up to date by uploading only the regions which changed since then.
+ */
+struct wlr_client_buffer_history {
+	uint64_t id; // unique, never re-used
+	uint32_t seq; // incremented each time the contents change
+	int width, height;
+	// damage[i] is the difference between contents seq - i - 1 and seq - i
+	pixman_region32_t damage[CLIENT_BUFFER_HISTORY_LEN];
+};
+
+void client_buffer_history_init(struct wlr_client_buffer_history *history);
+void client_buffer_history_finish(struct wlr_client_buffer_history *history);
+
+/**
+ * A pool of textures released by client buffers, keyed by size and format.
+ * Only textures holding a copy of the buffer contents are pooled.
+ */
+struct wlr_client_buffer_pool {
+	struct wlr_renderer *renderer; // NULL once destroyed
+	struct wl_list textures; // wlr_client_buffer_pool_texture.link
+	size_t textures_len;
+	size_t n_refs;
+	// Destroys textures which stayed idle for too long, NULL once destroyed
+	struct wl_event_source *trim_timer;
+};
+
+struct wlr_client_buffer_pool *client_buffer_pool_create(
+	struct wlr_renderer *renderer, struct wl_event_loop *event_loop);
+/**
+ * Destroy the pool. Client buffers created with the pool may outlive it, their
+ * texture will be destroyed instead of recycled.
+ */
+void client_buffer_pool_destroy(struct wlr_client_buffer_pool *pool);
+
+/**
+ * Get a client buffer holding the contents of next, given the client buffer
+ * holding the previous contents (may be NULL) and the damage between both.
+ *
+ * The previous client buffer is updated in place if possible. Otherwise, a
+ * texture is recycled from the pool and only the damage accumulated since the
+ * texture was last used is uploaded. If that isn't possible either, a new
+ * client buffer is created.
+ */
+struct wlr_client_buffer *client_buffer_update(
+	struct wlr_client_buffer_pool *pool,
+	struct wlr_client_buffer_history *history,
+	struct wlr_client_buffer *prev, struct wlr_buffer *next,
+	const pixman_region32_t *damage,
+	struct wlr_client_buffer_upload_stats *stats);
+
 #endif
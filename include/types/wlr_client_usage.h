@@ -0,0 +1,21 @@
+#ifndef TYPES_WLR_CLIENT_USAGE_H
+#define TYPES_WLR_CLIENT_USAGE_H
+
+#include <wlr/types/wlr_client_usage.h>
+
+void client_usage_charge_init(struct wlr_client_usage_charge *charge,
+	enum wlr_client_usage_type type);
+
+/**
+ * Update the amount of resources charged to a client.
+ *
+ * Returns false if the new amount would make the client exceed its budget
+ * and the budget is enforced, in which case the charge is left unchanged.
+ * Always succeeds if no struct wlr_client_usage_manager exists.
+ */
+bool client_usage_charge_set(struct wlr_client_usage_charge *charge,
+	struct wl_client *client, size_t size);
+
+void client_usage_charge_finish(struct wlr_client_usage_charge *charge);
+
+#endif
@@ -16,12 +16,25 @@ bool output_ensure_buffer(struct wlr_output *output,
 	struct wlr_output_state *state, bool *new_back_buffer);
 
 bool output_cursor_set_texture(struct wlr_output_cursor *cursor,
-	struct wlr_texture *texture, bool own_texture, const struct wlr_fbox *src_box,
-	int dst_width, int dst_height, enum wl_output_transform transform,
-	int32_t hotspot_x, int32_t hotspot_y);
+	struct wlr_texture *texture, bool own_texture, struct wlr_buffer *source,
+	const struct wlr_fbox *src_box, int dst_width, int dst_height,
+	enum wl_output_transform transform, int32_t hotspot_x, int32_t hotspot_y);
+/**
+ * Check whether the hardware cursor of the output may use a cursor source
+ * buffer without a render pass, i.e. whether it's worth passing the buffer to
+ * output_cursor_set_texture().
+ */
+bool output_cursor_source_is_usable(struct wlr_output *output,
+	struct wlr_buffer *source);
 
 void output_defer_present(struct wlr_output *output, struct wlr_output_event_present event);
 
+/**
+ * Reset a state to its initial value, but keep the storage allocated for the
+ * damage region so that it can be reused by the next frame.
+ */
+void output_state_reset(struct wlr_output_state *state);
+
 bool output_prepare_commit(struct wlr_output *output, const struct wlr_output_state *state);
 void output_apply_commit(struct wlr_output *output, const struct wlr_output_state *state);
 
@@ -0,0 +1,25 @@
+#ifndef TYPES_WLR_SHM_H
+#define TYPES_WLR_SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct wlr_buffer;
+
+/**
+ * Report whether a renderer managed to import the DMA-BUF exposed by a
+ * wl_shm buffer. After a failure, the buffer stops exposing a DMA-BUF and is
+ * uploaded instead.
+ *
+ * Does nothing if the buffer isn't a wl_shm buffer.
+ */
+void shm_buffer_report_dmabuf_import(struct wlr_buffer *buffer, bool success);
+
+/**
+ * Account for bytes copied from a wl_shm buffer into a texture.
+ *
+ * Does nothing if the buffer isn't a wl_shm buffer.
+ */
+void shm_buffer_report_upload(struct wlr_buffer *buffer, uint64_t bytes);
+
+#endif
@@ -52,6 +52,13 @@ struct wlr_backend *wlr_drm_backend_get_parent(struct wlr_backend *backend);
  */
 uint32_t wlr_drm_connector_get_id(struct wlr_output *output);
 
+/**
+ * Get the number of pixels copied from the primary GPU during the last
+ * primary plane commit. This is always zero if the connector is driven by the
+ * primary GPU.
+ */
+uint64_t wlr_drm_connector_get_mgpu_copied_pixels(struct wlr_output *output);
+
 /**
  * Tries to open non-master DRM FD. The compositor must not call drmSetMaster()
  * on the returned FD.
@@ -67,4 +67,39 @@ void wlr_wl_output_set_title(struct wlr_output *output, const char *title);
  */
 struct wl_surface *wlr_wl_output_get_surface(struct wlr_output *output);
 
+struct wlr_wl_output_stats {
+	// Buffers re-used from the wl_buffer import cache, and buffers which
+	// had to be imported into the parent compositor
+	size_t import_hits, import_misses;
+	// Number of commits currently waiting for presentation feedback
+	size_t frames_in_flight;
+	size_t frames_presented, frames_discarded;
+	// Round-trip latency between the commit and the presentation by the
+	// parent compositor, in nanoseconds
+	int64_t last_latency_nsec, max_latency_nsec;
+};
+
+/**
+ * Enable or disable pipelined mode for a Wayland output.
+ *
+ * By default the output waits for the parent compositor's frame callback
+ * before sending the next frame event, so at most one frame is in flight.
+ * In pipelined mode, up to two frames are kept in flight and frame events are
+ * scheduled from the presentation timings reported by the parent compositor.
+ * This hides the round-trip latency to the parent compositor at the cost of
+ * an additional frame of input latency.
+ *
+ * This requires the parent compositor to support the presentation-time
+ * protocol, otherwise frame callbacks are used as usual.
+ *
+ * The WLR_WL_PIPELINED environment variable sets the default.
+ */
+void wlr_wl_output_set_pipelined(struct wlr_output *output, bool pipelined);
+
+/**
+ * Get frame and buffer import statistics for a Wayland output.
+ */
+void wlr_wl_output_get_stats(struct wlr_output *output,
+	struct wlr_wl_output_stats *stats);
+
 #endif
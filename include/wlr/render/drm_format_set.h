@@ -47,6 +47,9 @@ void wlr_drm_format_finish(struct wlr_drm_format *format);
  *
  * Users must not assume that implicit modifiers are supported unless INVALID
  * is listed in the modifier list.
+ *
+ * Formats are sorted by format code, and the modifiers of each format are
+ * sorted in ascending order.
  */
 struct wlr_drm_format_set {
 	// The number of formats
@@ -0,0 +1,77 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_RENDER_RECORDER_H
+#define WLR_RENDER_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct wlr_allocator;
+struct wlr_render_pass;
+struct wlr_renderer;
+
+/**
+ * A render recorder captures the drawing operations of render passes, along
+ * with the contents of the textures they sample, so that they can be
+ * re-executed later on with wlr_render_recording_replay(), possibly with
+ * another renderer.
+ *
+ * The file format is private to wlroots and may change between versions. It
+ * is not portable across architectures.
+ */
+struct wlr_render_recorder;
+
+/**
+ * Create a recorder writing to the given file. The file isn't closed when
+ * the recorder is destroyed.
+ */
+struct wlr_render_recorder *wlr_render_recorder_create(FILE *f);
+
+void wlr_render_recorder_destroy(struct wlr_render_recorder *recorder);
+
+/**
+ * Wrap a render pass drawing to a buffer of the given size.
+ *
+ * Operations added to the returned render pass are forwarded to the wrapped
+ * render pass. Submitting the returned render pass submits the wrapped one,
+ * then writes the frame to the recording. Returns NULL on error, in which case
+ * the wrapped render pass is left untouched.
+ *
+ * Texture contents are read back after submission every time a texture is
+ * used in a new frame, which is slow: this is meant for debugging.
+ */
+struct wlr_render_pass *wlr_render_recorder_wrap_pass(
+	struct wlr_render_recorder *recorder, struct wlr_render_pass *pass,
+	int width, int height);
+
+struct wlr_render_replay_frame {
+	size_t index;
+	int width, height;
+	// Number of drawing operations in the frame
+	size_t ops;
+	// Time spent building and submitting the render pass, in nanoseconds
+	int64_t cpu_duration_ns;
+	// Render duration as reported by struct wlr_render_timer, in
+	// nanoseconds. Negative if unavailable.
+	int gpu_duration_ns;
+};
+
+/**
+ * Re-execute a recording with the given renderer. The frame_done callback is
+ * invoked after each frame has been submitted.
+ *
+ * Returns false if the recording is invalid or rendering failed.
+ */
+bool wlr_render_recording_replay(FILE *f, struct wlr_renderer *renderer,
+	struct wlr_allocator *allocator,
+	void (*frame_done)(const struct wlr_render_replay_frame *frame, void *data),
+	void *data);
+
+#endif
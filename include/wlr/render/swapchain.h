@@ -2,15 +2,19 @@
 #define WLR_RENDER_SWAPCHAIN_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/render/drm_format_set.h>
 
 #define WLR_SWAPCHAIN_CAP 4
+// Free buffers which haven't been used for this long are released on trim
+#define WLR_SWAPCHAIN_IDLE_TIMEOUT_MSEC 2000
 
 struct wlr_swapchain_slot {
 	struct wlr_buffer *buffer;
 	bool acquired; // waiting for release
 	int age;
+	int64_t last_used_msec; // CLOCK_MONOTONIC
 
 	struct wl_listener release;
 };
@@ -33,11 +37,25 @@ void wlr_swapchain_destroy(struct wlr_swapchain *swapchain);
 /**
  * Acquire a buffer from the swap chain.
  *
+ * Among the existing buffers, the one with the smallest age (and thus the
+ * least damage to repaint) is picked. A new buffer is only allocated if none
+ * is available. Buffers which haven't been used for a while are released.
+ *
  * The returned buffer is locked. When the caller is done with it, they must
  * unlock it by calling wlr_buffer_unlock.
  */
 struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 	int *age);
+/**
+ * Release the free buffers which haven't been used for
+ * WLR_SWAPCHAIN_IDLE_TIMEOUT_MSEC. The buffer which would be picked by the
+ * next wlr_swapchain_acquire() call is kept, so that the next frame doesn't
+ * need to be repainted from scratch.
+ *
+ * Users which may stop acquiring buffers for a long time (e.g. because the
+ * content is static) should call this once the timeout has elapsed.
+ */
+void wlr_swapchain_trim(struct wlr_swapchain *swapchain);
 /**
  * Returns true if this buffer has been created by this swapchain, and false
  * otherwise.
@@ -154,6 +154,22 @@ struct wlr_client_buffer {
 	struct wl_listener renderer_destroy;
 
 	size_t n_ignore_locks;
+
+	struct wlr_client_buffer_pool *pool; // may be NULL
+	uint32_t format; // DRM_FORMAT_INVALID if the texture can't be recycled
+	uint64_t history_id;
+	uint32_t history_seq;
+};
+
+/**
+ * Statistics about client buffer uploads.
+ */
+struct wlr_client_buffer_upload_stats {
+	// Uploads of whole buffers, and uploads of damaged regions only
+	size_t full_uploads, partial_uploads;
+	// Textures re-used from the pool instead of being allocated
+	size_t recycled_textures;
+	uint64_t uploaded_bytes;
 };
 
 /**
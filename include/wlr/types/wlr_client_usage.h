@@ -0,0 +1,111 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_CLIENT_USAGE_H
+#define WLR_TYPES_WLR_CLIENT_USAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wayland-server-core.h>
+
+enum wlr_client_usage_type {
+	// Bytes of wl_shm pools mapped into the compositor
+	WLR_CLIENT_USAGE_SHM,
+	// Bytes of textures uploaded from client buffers. Buffers imported
+	// without a copy aren't included.
+	WLR_CLIENT_USAGE_TEXTURE,
+	// Estimated bytes of imported linux-dmabuf buffers
+	WLR_CLIENT_USAGE_DMABUF,
+	// Number of surface states cached while waiting to be applied
+	WLR_CLIENT_USAGE_CACHED_STATE,
+
+	WLR_CLIENT_USAGE_TYPE_COUNT,
+};
+
+/**
+ * Keeps track of resources pinned by clients.
+ *
+ * Once created, wlr_shm, wlr_compositor and wlr_linux_dmabuf_v1 account the
+ * resources they hold on behalf of clients of the same struct wl_display.
+ */
+struct wlr_client_usage_manager {
+	struct wl_list usages; // wlr_client_usage.link
+
+	// Per-client limits, indexed by enum wlr_client_usage_type. Zero means
+	// unlimited.
+	size_t budget[WLR_CLIENT_USAGE_TYPE_COUNT];
+	// If true, requests which would make a client exceed its budget fail.
+	// Depending on the request, the client is either notified or
+	// disconnected. If false, the over_budget event is emitted but nothing
+	// else happens.
+	bool enforce_budget;
+
+	struct {
+		// struct wlr_client_usage_event_over_budget
+		struct wl_signal over_budget;
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+
+	// private state
+
+	struct wl_listener display_destroy;
+};
+
+/**
+ * Resources pinned by a single client.
+ */
+struct wlr_client_usage {
+	// NULL if the client has been destroyed, but some of its resources are
+	// still alive (e.g. buffers locked by the compositor)
+	struct wl_client *client;
+	struct wl_list link; // wlr_client_usage_manager.usages
+
+	// Indexed by enum wlr_client_usage_type
+	size_t current[WLR_CLIENT_USAGE_TYPE_COUNT];
+	size_t peak[WLR_CLIENT_USAGE_TYPE_COUNT];
+
+	// private state
+
+	struct wlr_client_usage_manager *manager; // may be NULL
+	size_t n_refs;
+
+	struct wl_listener client_destroy;
+};
+
+struct wlr_client_usage_event_over_budget {
+	struct wlr_client_usage *usage;
+	enum wlr_client_usage_type type;
+	// The amount the client tried to reach
+	size_t requested;
+	// Whether the request has been denied
+	bool rejected;
+};
+
+/**
+ * Resources of a single type charged to a client. Used internally by
+ * wlroots.
+ */
+struct wlr_client_usage_charge {
+	struct wlr_client_usage *usage; // NULL if nothing has been charged yet
+	enum wlr_client_usage_type type;
+	size_t size;
+};
+
+struct wlr_client_usage_manager *wlr_client_usage_manager_create(
+	struct wl_display *display);
+
+/**
+ * Get the resources pinned by a client. Returns NULL if no resources have
+ * been charged to the client yet.
+ */
+struct wlr_client_usage *wlr_client_usage_manager_get_client(
+	struct wlr_client_usage_manager *manager, struct wl_client *client);
+
+#endif
@@ -14,6 +14,8 @@
 #include <stdint.h>
 #include <time.h>
 #include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_client_usage.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/util/addon.h>
 #include <wlr/util/box.h>
@@ -235,8 +237,19 @@ struct wlr_surface {
 	struct wl_list synced; // wlr_surface_synced.link
 	size_t synced_len;
 
+	// Unused cached states kept around for re-use
+	struct wl_list cached_pool; // wlr_surface_state.cached_state_link
+	size_t cached_pool_len;
+
 	struct wl_resource *pending_buffer_resource;
 	struct wl_listener pending_buffer_resource_destroy;
+
+	struct wlr_client_buffer_history *buffer_history; // may be NULL
+
+	struct wl_list fence_waits; // wlr_surface_fence_wait.link
+
+	struct wlr_client_usage_charge usage_texture;
+	struct wlr_client_usage_charge usage_cached_states;
 };
 
 struct wlr_renderer;
@@ -245,6 +258,8 @@ struct wlr_compositor {
 	struct wl_global *global;
 	struct wlr_renderer *renderer; // may be NULL
 
+	struct wlr_client_buffer_upload_stats upload_stats;
+
 	struct wl_listener display_destroy;
 	struct wl_listener renderer_destroy;
 
@@ -252,6 +267,12 @@ struct wlr_compositor {
 		struct wl_signal new_surface;
 		struct wl_signal destroy;
 	} events;
+
+	// private state
+
+	struct wlr_client_buffer_pool *buffer_pool; // may be NULL
+	struct wl_event_loop *event_loop;
+	bool wait_dmabuf_fences;
 };
 
 typedef void (*wlr_surface_iterator_func_t)(struct wlr_surface *surface,
@@ -468,6 +489,11 @@ struct wlr_surface_synced_impl {
 	void (*finish_state)(void *state);
 	// Move a state. If NULL, memcpy() is used.
 	void (*move_state)(void *dst, void *src);
+	// Merge a state into an earlier one which hasn't been applied yet, as if
+	// both had been applied one after the other. Needs to be implemented if
+	// the state keeps track of which fields were committed. If NULL,
+	// move_state() is used.
+	void (*merge_state)(void *dst, void *src);
 };
 
 /**
@@ -536,4 +562,18 @@ struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 void wlr_compositor_set_renderer(struct wlr_compositor *compositor,
 	struct wlr_renderer *renderer);
 
+/**
+ * Enable or disable waiting for DMA-BUF implicit fences on surface commit.
+ *
+ * When enabled, surface commits with a DMA-BUF buffer are held back until the
+ * GPU work submitted by the client to render the buffer has completed. The
+ * compositor then always renders the last ready buffer instead of stalling on
+ * a slow client.
+ *
+ * This requires kernel support for exporting sync_files from DMA-BUFs. It is
+ * disabled by default.
+ */
+void wlr_compositor_set_wait_dmabuf_fences(struct wlr_compositor *compositor,
+	bool enabled);
+
 #endif
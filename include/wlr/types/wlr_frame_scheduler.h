@@ -0,0 +1,126 @@
+/*
+ * This an unstable interface of wlroots. No guarantees are made regarding the
+ * future consistency of this API.
+ */
+#ifndef WLR_USE_UNSTABLE
+#error "Add -DWLR_USE_UNSTABLE to enable unstable wlroots features"
+#endif
+
+#ifndef WLR_TYPES_WLR_FRAME_SCHEDULER_H
+#define WLR_TYPES_WLR_FRAME_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+#define WLR_FRAME_SCHEDULER_HISTORY 16
+
+struct wlr_output;
+struct wlr_frame_scheduler;
+
+/**
+ * A frame scheduling policy.
+ */
+struct wlr_frame_scheduler_policy {
+	/**
+	 * Predict how long the next frame will take to render, in nanoseconds.
+	 * Return a negative value to send frame events right away.
+	 */
+	int64_t (*predict_render_duration)(struct wlr_frame_scheduler *scheduler);
+};
+
+/**
+ * Sends frame events right away, as if no scheduler was used.
+ */
+extern const struct wlr_frame_scheduler_policy wlr_frame_scheduler_policy_immediate;
+/**
+ * Predicts the longest render duration from the recent history.
+ */
+extern const struct wlr_frame_scheduler_policy wlr_frame_scheduler_policy_max;
+/**
+ * Predicts the average render duration from the recent history.
+ */
+extern const struct wlr_frame_scheduler_policy wlr_frame_scheduler_policy_average;
+
+/**
+ * A frame scheduler delays an output's frame events until just before the
+ * predicted deadline of the next refresh cycle, instead of sending them right
+ * after the previous frame has been presented. This reduces the latency
+ * between the time the compositor renders a frame and the time it is
+ * displayed.
+ *
+ * Compositors should listen to the scheduler's frame event instead of the
+ * output's, and report how long each frame took to render with
+ * wlr_frame_scheduler_inform_render(), e.g. using
+ * wlr_scene_timer_get_duration_ns() or wlr_render_timer_get_duration_ns().
+ */
+struct wlr_frame_scheduler {
+	struct wlr_output *output;
+	const struct wlr_frame_scheduler_policy *policy;
+
+	// Extra time reserved for the commit to reach the hardware, in
+	// nanoseconds
+	int64_t margin_ns;
+
+	// Recent render durations in nanoseconds, oldest first
+	int64_t render_durations[WLR_FRAME_SCHEDULER_HISTORY];
+	size_t render_durations_len;
+
+	struct {
+		size_t frames;
+		// Frames for which the frame event has been delayed
+		size_t delayed_frames;
+		// Commits which happened after the predicted deadline
+		size_t missed_deadlines;
+		// Delay applied to the last frame event, in nanoseconds
+		int64_t last_delay_ns;
+	} stats;
+
+	struct {
+		// Same as wlr_output.events.frame, but delayed
+		struct wl_signal frame;
+		struct wl_signal destroy;
+	} events;
+
+	void *data;
+
+	// private state
+
+	struct wl_event_source *timer;
+	bool timer_armed;
+	int64_t last_present_ns;
+	int64_t refresh_ns;
+	int64_t deadline_ns;
+
+	struct wl_listener output_frame;
+	struct wl_listener output_commit;
+	struct wl_listener output_present;
+	struct wl_listener output_destroy;
+};
+
+/**
+ * Create a frame scheduler for an output. If policy is NULL,
+ * wlr_frame_scheduler_policy_max is used.
+ *
+ * The frame scheduler is destroyed together with the output.
+ */
+struct wlr_frame_scheduler *wlr_frame_scheduler_create(struct wlr_output *output,
+	const struct wlr_frame_scheduler_policy *policy);
+
+void wlr_frame_scheduler_destroy(struct wlr_frame_scheduler *scheduler);
+
+/**
+ * Change the scheduling policy. If policy is NULL,
+ * wlr_frame_scheduler_policy_max is used.
+ */
+void wlr_frame_scheduler_set_policy(struct wlr_frame_scheduler *scheduler,
+	const struct wlr_frame_scheduler_policy *policy);
+
+/**
+ * Report how long the last frame took to render, in nanoseconds. Negative
+ * durations (e.g. when a render timer is unavailable) are ignored.
+ */
+void wlr_frame_scheduler_inform_render(struct wlr_frame_scheduler *scheduler,
+	int64_t duration_ns);
+
+#endif
@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_client_usage.h>
 #include <wlr/render/dmabuf.h>
 #include <wlr/render/drm_format_set.h>
 
@@ -27,6 +28,7 @@ struct wlr_dmabuf_v1_buffer {
 	// private state
 
 	struct wl_listener release;
+	struct wlr_client_usage_charge usage_charge;
 };
 
 /**
@@ -60,6 +62,7 @@ struct wlr_linux_dmabuf_v1 {
 	struct wlr_linux_dmabuf_feedback_v1_compiled *default_feedback;
 	struct wlr_drm_format_set default_formats; // for legacy clients
 	struct wl_list surfaces; // wlr_linux_dmabuf_v1_surface.link
+	struct wl_list compiled_feedbacks; // wlr_linux_dmabuf_feedback_v1_compiled.link
 
 	int main_device_fd; // to sanity check FDs sent by clients, -1 if unavailable
 
@@ -185,6 +185,14 @@ struct wlr_output {
 
 	struct wl_event_source *idle_frame;
 	struct wl_event_source *idle_done;
+	struct wl_event_source *swapchain_trim_timer; // may be NULL
+	// Properties last sent to all wl_output resources
+	struct {
+		int32_t width, height, refresh;
+		enum wl_output_subpixel subpixel;
+		enum wl_output_transform transform;
+		int32_t scale;
+	} sent_state;
 
 	int attach_render_locks; // number of locks forcing rendering
 
@@ -302,6 +310,9 @@ void wlr_output_set_description(struct wlr_output *output, const char *desc);
 /**
  * Schedule a done event.
  *
+ * Pending wl_output mode, geometry and scale changes are sent right before
+ * the done event.
+ *
  * This is intended to be used by wl_output add-on interfaces.
  */
 void wlr_output_schedule_done(struct wlr_output *output);
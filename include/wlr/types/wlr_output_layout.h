@@ -39,6 +39,15 @@ struct wlr_output_layout {
 	// private state
 
 	struct wl_listener display_destroy;
+
+	// Grid of the distinct output edges, each cell points to the first
+	// output covering it. Rebuilt when the layout changes.
+	struct {
+		bool valid;
+		int *xs, *ys; // sorted edges
+		size_t xs_len, ys_len;
+		struct wlr_output_layout_output **cells; // row-major
+	} index;
 };
 
 struct wlr_output_layout_output {
@@ -58,6 +67,7 @@ struct wlr_output_layout_output {
 	// private state
 
 	struct wlr_addon addon;
+	struct wlr_box box; // cached, updated along with the index
 
 	struct wl_listener commit;
 };
@@ -25,6 +25,7 @@
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_damage_ring.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/util/addon.h>
 #include <wlr/util/box.h>
 
@@ -43,6 +44,7 @@ struct wlr_scene_output_layout;
 struct wlr_presentation;
 struct wlr_linux_dmabuf_v1;
 struct wlr_output_state;
+struct wlr_render_recorder;
 
 typedef bool (*wlr_scene_buffer_point_accepts_input_func_t)(
 	struct wlr_scene_buffer *buffer, double *sx, double *sy);
@@ -108,6 +110,10 @@ struct wlr_scene {
 	enum wlr_scene_debug_damage_option debug_damage_option;
 	bool direct_scanout;
 	bool calculate_visibility;
+
+	size_t transaction_depth;
+	pixman_region32_t transaction_update;
+	pixman_region32_t transaction_damage;
 };
 
 /** A scene-graph node displaying a single surface. */
@@ -182,7 +188,10 @@ struct wlr_scene_buffer {
 
 	// private state
 
-	uint64_t active_outputs;
+	// Bitset of outputs indexed by struct wlr_scene_output.index
+	uint64_t *active_outputs;
+	size_t active_outputs_len; // in words
+	struct wl_list primary_output_link; // wlr_scene_output.primary_buffers
 	struct wlr_texture *texture;
 	struct wlr_linux_dmabuf_feedback_v1_init_options prev_feedback_options;
 
@@ -212,8 +221,10 @@ struct wlr_scene_output {
 	// private state
 
 	pixman_region32_t pending_commit_damage;
+	// Reused across frames by wlr_scene_output_commit()
+	struct wlr_output_state commit_state;
 
-	uint8_t index;
+	size_t index;
 	bool prev_scanout;
 
 	struct wl_listener output_commit;
@@ -221,6 +232,7 @@ struct wlr_scene_output {
 	struct wl_listener output_needs_frame;
 
 	struct wl_list damage_highlight_regions;
+	struct wl_list primary_buffers; // wlr_scene_buffer.primary_output_link
 
 	struct wl_array render_list;
 };
@@ -316,6 +328,25 @@ struct wlr_scene *wlr_scene_create(void);
 void wlr_scene_set_linux_dmabuf_v1(struct wlr_scene *scene,
 	struct wlr_linux_dmabuf_v1 *linux_dmabuf_v1);
 
+/**
+ * Begin a scene transaction.
+ *
+ * Until the transaction is committed, node changes are accumulated instead of
+ * being applied one by one: node visibility, output damage and the
+ * output_enter, output_leave and outputs_update events of scene buffers are
+ * computed once for all changes when the transaction is committed. This is
+ * cheaper when many nodes are modified at once, e.g. during a layout change.
+ *
+ * Transactions can be nested, pending changes are applied when the outermost
+ * transaction is committed. They are also applied when building an output
+ * state with wlr_scene_output_build_state().
+ */
+void wlr_scene_transaction_begin(struct wlr_scene *scene);
+/**
+ * Commit a scene transaction started with wlr_scene_transaction_begin().
+ */
+void wlr_scene_transaction_commit(struct wlr_scene *scene);
+
 
 /**
  * Add a node displaying nothing but its children.
@@ -476,6 +507,11 @@ struct wlr_scene_output_state_options {
 	 * wlr_output_state or output size if not specified.
 	 */
 	struct wlr_swapchain *swapchain;
+
+	/**
+	 * Record the render pass, see struct wlr_render_recorder.
+	 */
+	struct wlr_render_recorder *recorder;
 };
 
 /**
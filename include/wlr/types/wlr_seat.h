@@ -67,6 +67,10 @@ struct wlr_seat_client {
 		int32_t last_discrete[2];
 		double acc_axis[2];
 	} value120;
+
+	// private state
+
+	struct wl_list bucket_link; // wlr_seat.client_buckets
 };
 
 struct wlr_touch_point {
@@ -298,6 +302,13 @@ struct wlr_seat {
 	} events;
 
 	void *data;
+
+	// private state
+
+	// Hash table of wlr_seat_client.bucket_link, indexed by wl_client
+	struct wl_list *client_buckets;
+	size_t client_buckets_len;
+	size_t clients_len;
 };
 
 struct wlr_seat_pointer_request_set_cursor_event {
@@ -9,6 +9,8 @@
 #ifndef WLR_TYPES_WLR_SHM_H
 #define WLR_TYPES_WLR_SHM_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 
 struct wlr_renderer;
@@ -17,18 +19,33 @@ struct wlr_renderer;
  * Shared memory buffer interface.
  *
  * The buffers created via this interface are not safe to use from different
- * threads.
+ * threads, with one exception: if the client's pool is backed by a file sealed
+ * with F_SEAL_SHRINK, the pointer returned by
+ * wlr_buffer_begin_data_ptr_access() may be read from any thread, and
+ * wlr_buffer_end_data_ptr_access() may be called from any thread. The access
+ * still needs to begin on the thread dispatching the struct wl_display.
  *
- * Currently, accessing two buffers concurrently via
- * wlr_buffer_begin_data_ptr_access() will return an error.
+ * Accesses to other buffers rely on a process-wide SIGBUS handler in case the
+ * client shrinks the file, and must stay on the struct wl_display thread.
  */
 struct wlr_shm {
 	struct wl_global *global;
 
+	struct {
+		// Buffers wrapped into a DMA-BUF and imported by a renderer
+		size_t udmabuf_exports;
+		// Buffers which could not be wrapped or imported, and need to be
+		// copied
+		size_t udmabuf_failures;
+		// Bytes copied from buffers into textures
+		uint64_t uploaded_bytes;
+	} stats;
+
 	// private state
 
 	uint32_t *formats;
 	size_t formats_len;
+	bool udmabuf_enabled;
 
 	struct wl_listener display_destroy;
 };
@@ -50,4 +67,18 @@ struct wlr_shm *wlr_shm_create(struct wl_display *display, uint32_t version,
 struct wlr_shm *wlr_shm_create_with_renderer(struct wl_display *display,
 	uint32_t version, struct wlr_renderer *renderer);
 
+/**
+ * Enable or disable zero-copy import of shared memory buffers.
+ *
+ * When enabled, buffers from pools backed by a memfd sealed with
+ * F_SEAL_SHRINK are exposed as DMA-BUFs via /dev/udmabuf, which renderers can
+ * import without a CPU copy. Other buffers, or systems without udmabuf,
+ * transparently fall back to uploads.
+ *
+ * Since the renderer then reads the client's memory directly, buffers are
+ * only released once the compositor is done sampling them. Disabled by
+ * default.
+ */
+void wlr_shm_set_udmabuf_enabled(struct wlr_shm *shm, bool enabled);
+
 #endif
@@ -1,7 +1,10 @@
+#include <fcntl.h>
 #include <linux/dma-buf.h>
 #include <linux/version.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 #include <sys/utsname.h>
+#include <unistd.h>
 #include <wlr/util/log.h>
 #include <xf86drm.h>
 
@@ -97,3 +100,50 @@ int dmabuf_export_sync_file(int dmabuf_fd, uint32_t flags) {
 	}
 	return data.fd;
 }
+
+// Copied from <linux/udmabuf.h> and <linux/fcntl.h>, these aren't always
+// available
+
+struct wlr_udmabuf_create {
+	__u32 memfd;
+	__u32 flags;
+	__u64 offset;
+	__u64 size;
+};
+
+#define WLR_UDMABUF_FLAGS_CLOEXEC 0x01
+#define WLR_UDMABUF_CREATE _IOW('u', 0x42, struct wlr_udmabuf_create)
+
+#if !defined(F_GET_SEALS)
+#define F_GET_SEALS 1034
+#endif
+#if !defined(F_SEAL_SHRINK)
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+int dmabuf_create_from_memfd(int memfd, uint64_t offset, uint64_t size) {
+	// udmabuf refuses memfds which can shrink under its feet
+	int seals = fcntl(memfd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+		return -1;
+	}
+
+	int udmabuf_fd = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+	if (udmabuf_fd < 0) {
+		wlr_log_errno(WLR_DEBUG, "Failed to open /dev/udmabuf");
+		return -1;
+	}
+
+	struct wlr_udmabuf_create create = {
+		.memfd = memfd,
+		.flags = WLR_UDMABUF_FLAGS_CLOEXEC,
+		.offset = offset,
+		.size = size,
+	};
+	int dmabuf_fd = drmIoctl(udmabuf_fd, WLR_UDMABUF_CREATE, &create);
+	if (dmabuf_fd < 0) {
+		wlr_log_errno(WLR_DEBUG, "drmIoctl(UDMABUF_CREATE) failed");
+	}
+	close(udmabuf_fd);
+	return dmabuf_fd;
+}
@@ -27,15 +27,55 @@ void wlr_drm_format_set_finish(struct wlr_drm_format_set *set) {
 	set->formats = NULL;
 }
 
+// Formats are kept sorted by format code, and modifiers are kept sorted in
+// ascending order, so that lookups can use a binary search and set operations
+// can merge both sides in a single pass.
+
+// Returns the index of the format, or the index where it should be inserted
+static size_t format_set_find(const struct wlr_drm_format_set *set,
+		uint32_t format, bool *found) {
+	size_t lo = 0, hi = set->len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint32_t cur = set->formats[mid].format;
+		if (cur == format) {
+			*found = true;
+			return mid;
+		} else if (cur < format) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*found = false;
+	return lo;
+}
+
 static struct wlr_drm_format *format_set_get(const struct wlr_drm_format_set *set,
 		uint32_t format) {
-	for (size_t i = 0; i < set->len; ++i) {
-		if (set->formats[i].format == format) {
-			return &set->formats[i];
+	bool found;
+	size_t i = format_set_find(set, format, &found);
+	return found ? &set->formats[i] : NULL;
+}
+
+// Returns the index of the modifier, or the index where it should be inserted
+static size_t format_find(const struct wlr_drm_format *fmt, uint64_t modifier,
+		bool *found) {
+	size_t lo = 0, hi = fmt->len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint64_t cur = fmt->modifiers[mid];
+		if (cur == modifier) {
+			*found = true;
+			return mid;
+		} else if (cur < modifier) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
 	}
-
-	return NULL;
+	*found = false;
+	return lo;
 }
 
 const struct wlr_drm_format *wlr_drm_format_set_get(
@@ -52,13 +92,35 @@ bool wlr_drm_format_set_has(const struct wlr_drm_format_set *set,
 	return wlr_drm_format_has(fmt, modifier);
 }
 
+static bool format_set_reserve(struct wlr_drm_format_set *set, size_t len) {
+	if (len <= set->capacity) {
+		return true;
+	}
+
+	size_t capacity = set->capacity ? set->capacity * 2 : 4;
+	if (capacity < len) {
+		capacity = len;
+	}
+
+	struct wlr_drm_format *fmts = realloc(set->formats, sizeof(*fmts) * capacity);
+	if (!fmts) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+
+	set->capacity = capacity;
+	set->formats = fmts;
+	return true;
+}
+
 bool wlr_drm_format_set_add(struct wlr_drm_format_set *set, uint32_t format,
 		uint64_t modifier) {
 	assert(format != DRM_FORMAT_INVALID);
 
-	struct wlr_drm_format *existing = format_set_get(set, format);
-	if (existing) {
-		return wlr_drm_format_add(existing, modifier);
+	bool found;
+	size_t idx = format_set_find(set, format, &found);
+	if (found) {
+		return wlr_drm_format_add(&set->formats[idx], modifier);
 	}
 
 	struct wlr_drm_format fmt;
@@ -68,21 +130,15 @@ bool wlr_drm_format_set_add(struct wlr_drm_format_set *set, uint32_t format,
 		return false;
 	}
 
-	if (set->len == set->capacity) {
-		size_t capacity = set->capacity ? set->capacity * 2 : 4;
-
-		struct wlr_drm_format *fmts = realloc(set->formats, sizeof(*fmts) * capacity);
-		if (!fmts) {
-			wlr_log_errno(WLR_ERROR, "Allocation failed");
-			wlr_drm_format_finish(&fmt);
-			return false;
-		}
-
-		set->capacity = capacity;
-		set->formats = fmts;
+	if (!format_set_reserve(set, set->len + 1)) {
+		wlr_drm_format_finish(&fmt);
+		return false;
 	}
 
-	set->formats[set->len++] = fmt;
+	memmove(&set->formats[idx + 1], &set->formats[idx],
+		(set->len - idx) * sizeof(set->formats[0]));
+	set->formats[idx] = fmt;
+	set->len++;
 	return true;
 }
 
@@ -93,16 +149,15 @@ void wlr_drm_format_init(struct wlr_drm_format *fmt, uint32_t format) {
 }
 
 bool wlr_drm_format_has(const struct wlr_drm_format *fmt, uint64_t modifier) {
-	for (size_t i = 0; i < fmt->len; ++i) {
-		if (fmt->modifiers[i] == modifier) {
-			return true;
-		}
-	}
-	return false;
+	bool found;
+	format_find(fmt, modifier, &found);
+	return found;
 }
 
 bool wlr_drm_format_add(struct wlr_drm_format *fmt, uint64_t modifier) {
-	if (wlr_drm_format_has(fmt, modifier)) {
+	bool found;
+	size_t idx = format_find(fmt, modifier, &found);
+	if (found) {
 		return true;
 	}
 
@@ -119,7 +174,10 @@ bool wlr_drm_format_add(struct wlr_drm_format *fmt, uint64_t modifier) {
 		fmt->modifiers = new_modifiers;
 	}
 
-	fmt->modifiers[fmt->len++] = modifier;
+	memmove(&fmt->modifiers[idx + 1], &fmt->modifiers[idx],
+		(fmt->len - idx) * sizeof(fmt->modifiers[0]));
+	fmt->modifiers[idx] = modifier;
+	fmt->len++;
 	return true;
 }
 
@@ -186,13 +244,17 @@ bool wlr_drm_format_intersect(struct wlr_drm_format *dst,
 		.format = a->format,
 	};
 
-	for (size_t i = 0; i < a->len; i++) {
-		for (size_t j = 0; j < b->len; j++) {
-			if (a->modifiers[i] == b->modifiers[j]) {
-				assert(fmt.len < fmt.capacity);
-				fmt.modifiers[fmt.len++] = a->modifiers[i];
-				break;
-			}
+	size_t i = 0, j = 0;
+	while (i < a->len && j < b->len) {
+		if (a->modifiers[i] < b->modifiers[j]) {
+			i++;
+		} else if (a->modifiers[i] > b->modifiers[j]) {
+			j++;
+		} else {
+			assert(fmt.len < fmt.capacity);
+			fmt.modifiers[fmt.len++] = a->modifiers[i];
+			i++;
+			j++;
 		}
 	}
 
@@ -211,28 +273,34 @@ bool wlr_drm_format_set_intersect(struct wlr_drm_format_set *dst,
 		return false;
 	}
 
-	for (size_t i = 0; i < a->len; i++) {
-		for (size_t j = 0; j < b->len; j++) {
-			if (a->formats[i].format == b->formats[j].format) {
-				// When the two formats have no common modifier, keep
-				// intersecting the rest of the formats: they may be compatible
-				// with each other
-				out.formats[out.len] = (struct wlr_drm_format){0};
-				if (!wlr_drm_format_intersect(&out.formats[out.len],
-						&a->formats[i], &b->formats[j])) {
-					wlr_drm_format_set_finish(&out);
-					return false;
-				}
-
-				if (out.formats[out.len].len == 0) {
-					wlr_drm_format_finish(&out.formats[out.len]);
-				} else {
-					out.len++;
-				}
-
-				break;
-			}
+	size_t i = 0, j = 0;
+	while (i < a->len && j < b->len) {
+		if (a->formats[i].format < b->formats[j].format) {
+			i++;
+			continue;
+		} else if (a->formats[i].format > b->formats[j].format) {
+			j++;
+			continue;
 		}
+
+		// When the two formats have no common modifier, keep
+		// intersecting the rest of the formats: they may be compatible
+		// with each other
+		out.formats[out.len] = (struct wlr_drm_format){0};
+		if (!wlr_drm_format_intersect(&out.formats[out.len],
+				&a->formats[i], &b->formats[j])) {
+			wlr_drm_format_set_finish(&out);
+			return false;
+		}
+
+		if (out.formats[out.len].len == 0) {
+			wlr_drm_format_finish(&out.formats[out.len]);
+		} else {
+			out.len++;
+		}
+
+		i++;
+		j++;
 	}
 
 	if (out.len == 0) {
@@ -245,18 +313,39 @@ bool wlr_drm_format_set_intersect(struct wlr_drm_format_set *dst,
 	return true;
 }
 
-static bool drm_format_set_extend(struct wlr_drm_format_set *dst,
-		const struct wlr_drm_format_set *src) {
-	for (size_t i = 0; i < src->len; i++) {
-		struct wlr_drm_format *format = &src->formats[i];
-		for (size_t j = 0; j < format->len; j++) {
-			if (!wlr_drm_format_set_add(dst, format->format, format->modifiers[j])) {
-				wlr_log_errno(WLR_ERROR, "Adding format/modifier to set failed");
-				return false;
-			}
+// Merge the modifiers of two formats with the same format code
+static bool drm_format_union(struct wlr_drm_format *dst,
+		const struct wlr_drm_format *a, const struct wlr_drm_format *b) {
+	assert(a->format == b->format);
+
+	size_t capacity = a->len + b->len;
+	uint64_t *modifiers = malloc(sizeof(*modifiers) * capacity);
+	if (!modifiers) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+
+	struct wlr_drm_format fmt = {
+		.capacity = capacity,
+		.len = 0,
+		.modifiers = modifiers,
+		.format = a->format,
+	};
+
+	size_t i = 0, j = 0;
+	while (i < a->len || j < b->len) {
+		if (j == b->len || (i < a->len && a->modifiers[i] < b->modifiers[j])) {
+			fmt.modifiers[fmt.len++] = a->modifiers[i++];
+		} else if (i == a->len || b->modifiers[j] < a->modifiers[i]) {
+			fmt.modifiers[fmt.len++] = b->modifiers[j++];
+		} else {
+			fmt.modifiers[fmt.len++] = a->modifiers[i];
+			i++;
+			j++;
 		}
 	}
 
+	*dst = fmt;
 	return true;
 }
 
@@ -270,11 +359,27 @@ bool wlr_drm_format_set_union(struct wlr_drm_format_set *dst,
 		return false;
 	}
 
-	// Add both a and b sets into out
-	if (!drm_format_set_extend(&out, a) ||
-		!drm_format_set_extend(&out, b)) {
-		wlr_drm_format_set_finish(&out);
-		return false;
+	// Merge both sorted sets into out
+	size_t i = 0, j = 0;
+	while (i < a->len || j < b->len) {
+		struct wlr_drm_format *fmt = &out.formats[out.len];
+		*fmt = (struct wlr_drm_format){0};
+
+		bool ok;
+		if (j == b->len || (i < a->len &&
+				a->formats[i].format < b->formats[j].format)) {
+			ok = wlr_drm_format_copy(fmt, &a->formats[i++]);
+		} else if (i == a->len ||
+				b->formats[j].format < a->formats[i].format) {
+			ok = wlr_drm_format_copy(fmt, &b->formats[j++]);
+		} else {
+			ok = drm_format_union(fmt, &a->formats[i++], &b->formats[j++]);
+		}
+		if (!ok) {
+			wlr_drm_format_set_finish(&out);
+			return false;
+		}
+		out.len++;
 	}
 
 	wlr_drm_format_set_finish(dst);
@@ -14,6 +14,7 @@
 #include "render/gles2.h"
 #include "render/pixel_format.h"
 #include "types/wlr_buffer.h"
+#include "types/wlr_shm.h"
 
 static const struct wlr_texture_impl texture_impl;
 
@@ -418,8 +419,16 @@ struct wlr_texture *gles2_texture_from_buffer(struct wlr_renderer *wlr_renderer,
 	size_t stride;
 	struct wlr_dmabuf_attributes dmabuf;
 	if (wlr_buffer_get_dmabuf(buffer, &dmabuf)) {
-		return gles2_texture_from_dmabuf(renderer, buffer, &dmabuf);
-	} else if (wlr_buffer_begin_data_ptr_access(buffer,
+		struct wlr_texture *tex = gles2_texture_from_dmabuf(renderer, buffer, &dmabuf);
+		shm_buffer_report_dmabuf_import(buffer, tex != NULL);
+		if (tex != NULL) {
+			return tex;
+		}
+		// Buffers may expose both a DMA-BUF and CPU access (e.g. shared
+		// memory wrapped via udmabuf): fall back to an upload
+	}
+
+	if (wlr_buffer_begin_data_ptr_access(buffer,
 			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
 		struct wlr_texture *tex = gles2_texture_from_pixels(wlr_renderer,
 			format, stride, buffer->width, buffer->height, data);
@@ -0,0 +1,821 @@
+#include <assert.h>
+#include <drm_fourcc.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-util.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/recorder.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/util/log.h>
+#include "render/pixel_format.h"
+#include "render/wlr_renderer.h"
+#include "util/time.h"
+
+#define RECORDING_MAGIC "WLRRREC"
+#define RECORDING_VERSION 1
+
+// Upper bound for a single record, to reject garbage early
+static const uint32_t max_record_size = 256 * 1024 * 1024; // 256MB
+
+enum recording_op {
+	RECORDING_OP_FRAME = 1,
+	RECORDING_OP_TEXTURE,
+	RECORDING_OP_ADD_TEXTURE,
+	RECORDING_OP_ADD_RECT,
+	RECORDING_OP_SUBMIT,
+};
+
+struct recording_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+// Each record starts with this header, followed by size bytes of payload
+struct recording_record {
+	uint32_t op; // enum recording_op
+	uint32_t size;
+};
+
+struct recording_frame {
+	int32_t width, height;
+};
+
+// Followed by stride * height bytes of pixel data, unless format is
+// DRM_FORMAT_INVALID (the texture couldn't be read back)
+struct recording_texture {
+	uint32_t id;
+	uint32_t width, height;
+	uint32_t format;
+	uint32_t stride;
+	uint32_t reserved;
+};
+
+// Both are followed by n_clip_rects pixman_box32_t
+struct recording_add_texture {
+	uint32_t texture_id;
+	uint32_t transform, filter_mode, blend_mode;
+	double src_x, src_y, src_width, src_height;
+	int32_t dst_x, dst_y, dst_width, dst_height;
+	float alpha;
+	uint32_t has_clip;
+	uint32_t n_clip_rects;
+	uint32_t reserved;
+};
+
+struct recording_add_rect {
+	int32_t x, y, width, height;
+	float r, g, b, a;
+	uint32_t blend_mode;
+	uint32_t has_clip;
+	uint32_t n_clip_rects;
+	uint32_t reserved;
+};
+
+struct wlr_render_recorder {
+	FILE *f;
+	bool failed;
+	struct wl_array textures; // struct recorder_texture, indexed by texture ID
+	// Open addressing hash table of texture IDs plus one (zero marks an empty
+	// bucket), keyed by recorder_texture.hash
+	uint32_t *buckets;
+	size_t buckets_len; // power of two
+};
+
+struct recorder_texture {
+	uint64_t hash;
+	uint32_t width, height;
+	uint32_t format;
+	uint32_t stride;
+};
+
+struct recorded_texture {
+	struct wlr_texture *texture;
+	uint32_t id;
+};
+
+struct wlr_recording_pass {
+	struct wlr_render_pass base;
+	struct wlr_render_recorder *recorder;
+	struct wlr_render_pass *wrapped;
+	int width, height;
+	// Indexed by the pass-local texture IDs used in ops
+	struct wl_array textures; // struct recorded_texture
+	// Records written on submit, texture IDs are pass-local
+	struct wl_array ops;
+};
+
+static void recorder_write(struct wlr_render_recorder *recorder,
+		const void *data, size_t size) {
+	if (recorder->failed || size == 0) {
+		return;
+	}
+	if (fwrite(data, size, 1, recorder->f) != 1) {
+		wlr_log_errno(WLR_ERROR, "Failed to write render recording");
+		recorder->failed = true;
+	}
+}
+
+static void recorder_write_record(struct wlr_render_recorder *recorder,
+		enum recording_op op, const void *payload, size_t payload_size,
+		const void *extra, size_t extra_size) {
+	struct recording_record record = {
+		.op = op,
+		.size = payload_size + extra_size,
+	};
+	recorder_write(recorder, &record, sizeof(record));
+	recorder_write(recorder, payload, payload_size);
+	recorder_write(recorder, extra, extra_size);
+}
+
+struct wlr_render_recorder *wlr_render_recorder_create(FILE *f) {
+	struct wlr_render_recorder *recorder = calloc(1, sizeof(*recorder));
+	if (recorder == NULL) {
+		return NULL;
+	}
+	recorder->f = f;
+	wl_array_init(&recorder->textures);
+
+	struct recording_header header = {
+		.magic = RECORDING_MAGIC,
+		.version = RECORDING_VERSION,
+	};
+	recorder_write(recorder, &header, sizeof(header));
+
+	return recorder;
+}
+
+void wlr_render_recorder_destroy(struct wlr_render_recorder *recorder) {
+	if (recorder == NULL) {
+		return;
+	}
+	fflush(recorder->f);
+	wl_array_release(&recorder->textures);
+	free(recorder->buckets);
+	free(recorder);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+	// FNV-1a
+	const uint8_t *bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static bool recorder_texture_equal(const struct recorder_texture *a,
+		const struct recorder_texture *b) {
+	return a->hash == b->hash && a->width == b->width &&
+		a->height == b->height && a->format == b->format &&
+		a->stride == b->stride;
+}
+
+// Returns the bucket holding the texture, or the empty bucket where it
+// should be inserted
+static uint32_t *recorder_find_bucket(struct wlr_render_recorder *recorder,
+		const struct recorder_texture *key) {
+	const struct recorder_texture *textures = recorder->textures.data;
+	size_t mask = recorder->buckets_len - 1;
+	for (size_t i = key->hash & mask;; i = (i + 1) & mask) {
+		uint32_t *bucket = &recorder->buckets[i];
+		if (*bucket == 0 || recorder_texture_equal(&textures[*bucket - 1], key)) {
+			return bucket;
+		}
+	}
+}
+
+static bool recorder_grow_buckets(struct wlr_render_recorder *recorder) {
+	size_t buckets_len = recorder->buckets_len > 0 ?
+		recorder->buckets_len * 2 : 64;
+	uint32_t *buckets = calloc(buckets_len, sizeof(*buckets));
+	if (buckets == NULL) {
+		wlr_log_errno(WLR_ERROR, "Allocation failed");
+		return false;
+	}
+	free(recorder->buckets);
+	recorder->buckets = buckets;
+	recorder->buckets_len = buckets_len;
+
+	const struct recorder_texture *textures = recorder->textures.data;
+	size_t textures_len = recorder->textures.size / sizeof(textures[0]);
+	for (size_t id = 0; id < textures_len; id++) {
+		*recorder_find_bucket(recorder, &textures[id]) = id + 1;
+	}
+	return true;
+}
+
+static uint32_t recorder_add_texture(struct wlr_render_recorder *recorder,
+		struct wlr_texture *texture) {
+	struct recording_texture rec = {
+		.width = texture->width,
+		.height = texture->height,
+		.format = wlr_texture_preferred_read_format(texture),
+	};
+
+	void *data = NULL;
+	size_t data_size = 0;
+	const struct wlr_pixel_format_info *info =
+		drm_get_pixel_format_info(rec.format);
+	if (info != NULL) {
+		rec.stride = pixel_format_info_min_stride(info, rec.width);
+		data_size = (size_t)rec.stride * rec.height;
+		data = data_size <= max_record_size ? malloc(data_size) : NULL;
+	}
+	if (data == NULL || !wlr_texture_read_pixels(texture,
+			&(struct wlr_texture_read_pixels_options){
+				.data = data,
+				.format = rec.format,
+				.stride = rec.stride,
+			})) {
+		wlr_log(WLR_DEBUG, "Failed to read back texture, "
+			"recording a placeholder");
+		free(data);
+		data = NULL;
+		data_size = 0;
+		rec.format = DRM_FORMAT_INVALID;
+		rec.stride = 0;
+	}
+
+	// Textures are identified by their contents, so that they're only
+	// written once even if they're re-used across frames
+	struct recorder_texture key = {
+		.hash = hash_bytes(0xcbf29ce484222325, data, data_size),
+		.width = rec.width,
+		.height = rec.height,
+		.format = rec.format,
+		.stride = rec.stride,
+	};
+
+	size_t textures_len = recorder->textures.size / sizeof(key);
+	if ((textures_len + 1) * 2 > recorder->buckets_len &&
+			!recorder_grow_buckets(recorder)) {
+		recorder->failed = true;
+		free(data);
+		return 0;
+	}
+
+	uint32_t *bucket = recorder_find_bucket(recorder, &key);
+	if (*bucket != 0) {
+		free(data);
+		return *bucket - 1;
+	}
+
+	struct recorder_texture *entry =
+		wl_array_add(&recorder->textures, sizeof(*entry));
+	if (entry == NULL) {
+		recorder->failed = true;
+		free(data);
+		return 0;
+	}
+	*entry = key;
+	*bucket = textures_len + 1;
+
+	rec.id = textures_len;
+	recorder_write_record(recorder, RECORDING_OP_TEXTURE,
+		&rec, sizeof(rec), data, data_size);
+	free(data);
+	return rec.id;
+}
+
+static uint32_t recording_pass_get_texture_id(struct wlr_recording_pass *pass,
+		struct wlr_texture *texture) {
+	uint32_t id = 0;
+	struct recorded_texture *recorded;
+	wl_array_for_each(recorded, &pass->textures) {
+		if (recorded->texture == texture) {
+			return id;
+		}
+		id++;
+	}
+
+	recorded = wl_array_add(&pass->textures, sizeof(*recorded));
+	if (recorded == NULL) {
+		pass->recorder->failed = true;
+		return 0;
+	}
+	*recorded = (struct recorded_texture){
+		.texture = texture,
+	};
+	return id;
+}
+
+static void recording_pass_add_record(struct wlr_recording_pass *pass,
+		enum recording_op op, const void *payload, size_t payload_size,
+		const void *extra, size_t extra_size) {
+	struct recording_record record = {
+		.op = op,
+		.size = payload_size + extra_size,
+	};
+	char *ptr = wl_array_add(&pass->ops, sizeof(record) + record.size);
+	if (ptr == NULL) {
+		pass->recorder->failed = true;
+		return;
+	}
+	memcpy(ptr, &record, sizeof(record));
+	memcpy(ptr + sizeof(record), payload, payload_size);
+	if (extra_size > 0) {
+		memcpy(ptr + sizeof(record) + payload_size, extra, extra_size);
+	}
+}
+
+static void write_clip(const pixman_region32_t *clip, uint32_t *has_clip,
+		uint32_t *n_clip_rects, const pixman_box32_t **rects) {
+	*has_clip = clip != NULL;
+	*n_clip_rects = 0;
+	*rects = NULL;
+	if (clip != NULL) {
+		int n = 0;
+		*rects = pixman_region32_rectangles(clip, &n);
+		*n_clip_rects = n;
+	}
+}
+
+static const struct wlr_render_pass_impl recording_pass_impl;
+
+static struct wlr_recording_pass *get_recording_pass(
+		struct wlr_render_pass *wlr_pass) {
+	assert(wlr_pass->impl == &recording_pass_impl);
+	struct wlr_recording_pass *pass = wl_container_of(wlr_pass, pass, base);
+	return pass;
+}
+
+static bool recording_pass_submit(struct wlr_render_pass *wlr_pass) {
+	struct wlr_recording_pass *pass = get_recording_pass(wlr_pass);
+	struct wlr_render_recorder *recorder = pass->recorder;
+
+	// Textures are only read back once the wrapped pass has been submitted:
+	// reading back a texture in the middle of a pass may clobber renderer
+	// state, e.g. the framebuffer bound by the GLES2 renderer
+	bool ok = wlr_render_pass_submit(pass->wrapped);
+
+	struct recording_frame frame = {
+		.width = pass->width,
+		.height = pass->height,
+	};
+	recorder_write_record(recorder, RECORDING_OP_FRAME,
+		&frame, sizeof(frame), NULL, 0);
+
+	struct recorded_texture *recorded;
+	wl_array_for_each(recorded, &pass->textures) {
+		if (recorder->failed) {
+			break;
+		}
+		recorded->id = recorder_add_texture(recorder, recorded->texture);
+	}
+
+	// Translate pass-local texture IDs into recording ones
+	const struct recorded_texture *textures = pass->textures.data;
+	size_t textures_len = pass->textures.size / sizeof(textures[0]);
+	char *ptr = pass->ops.data;
+	char *end = ptr + pass->ops.size;
+	while (ptr < end) {
+		struct recording_record record;
+		memcpy(&record, ptr, sizeof(record));
+		if (record.op == RECORDING_OP_ADD_TEXTURE) {
+			char *id_ptr = ptr + sizeof(record) +
+				offsetof(struct recording_add_texture, texture_id);
+			uint32_t id;
+			memcpy(&id, id_ptr, sizeof(id));
+			id = id < textures_len ? textures[id].id : 0;
+			memcpy(id_ptr, &id, sizeof(id));
+		}
+		ptr += sizeof(record) + record.size;
+	}
+	recorder_write(recorder, pass->ops.data, pass->ops.size);
+
+	recorder_write_record(recorder, RECORDING_OP_SUBMIT, NULL, 0, NULL, 0);
+	if (!recorder->failed && fflush(recorder->f) != 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to write render recording");
+		recorder->failed = true;
+	}
+
+	wl_array_release(&pass->textures);
+	wl_array_release(&pass->ops);
+	free(pass);
+	return ok;
+}
+
+static void recording_pass_add_texture(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_texture_options *options) {
+	struct wlr_recording_pass *pass = get_recording_pass(wlr_pass);
+
+	struct recording_add_texture rec = {
+		.texture_id = recording_pass_get_texture_id(pass, options->texture),
+		.transform = options->transform,
+		.filter_mode = options->filter_mode,
+		.blend_mode = options->blend_mode,
+		.src_x = options->src_box.x,
+		.src_y = options->src_box.y,
+		.src_width = options->src_box.width,
+		.src_height = options->src_box.height,
+		.dst_x = options->dst_box.x,
+		.dst_y = options->dst_box.y,
+		.dst_width = options->dst_box.width,
+		.dst_height = options->dst_box.height,
+		.alpha = wlr_render_texture_options_get_alpha(options),
+	};
+	const pixman_box32_t *rects;
+	write_clip(options->clip, &rec.has_clip, &rec.n_clip_rects, &rects);
+	recording_pass_add_record(pass, RECORDING_OP_ADD_TEXTURE,
+		&rec, sizeof(rec), rects, rec.n_clip_rects * sizeof(rects[0]));
+
+	wlr_render_pass_add_texture(pass->wrapped, options);
+}
+
+static void recording_pass_add_rect(struct wlr_render_pass *wlr_pass,
+		const struct wlr_render_rect_options *options) {
+	struct wlr_recording_pass *pass = get_recording_pass(wlr_pass);
+
+	struct recording_add_rect rec = {
+		.x = options->box.x,
+		.y = options->box.y,
+		.width = options->box.width,
+		.height = options->box.height,
+		.r = options->color.r,
+		.g = options->color.g,
+		.b = options->color.b,
+		.a = options->color.a,
+		.blend_mode = options->blend_mode,
+	};
+	const pixman_box32_t *rects;
+	write_clip(options->clip, &rec.has_clip, &rec.n_clip_rects, &rects);
+	recording_pass_add_record(pass, RECORDING_OP_ADD_RECT,
+		&rec, sizeof(rec), rects, rec.n_clip_rects * sizeof(rects[0]));
+
+	wlr_render_pass_add_rect(pass->wrapped, options);
+}
+
+static const struct wlr_render_pass_impl recording_pass_impl = {
+	.submit = recording_pass_submit,
+	.add_texture = recording_pass_add_texture,
+	.add_rect = recording_pass_add_rect,
+};
+
+struct wlr_render_pass *wlr_render_recorder_wrap_pass(
+		struct wlr_render_recorder *recorder, struct wlr_render_pass *wrapped,
+		int width, int height) {
+	struct wlr_recording_pass *pass = calloc(1, sizeof(*pass));
+	if (pass == NULL) {
+		return NULL;
+	}
+	wlr_render_pass_init(&pass->base, &recording_pass_impl);
+	pass->recorder = recorder;
+	pass->wrapped = wrapped;
+	pass->width = width;
+	pass->height = height;
+	wl_array_init(&pass->textures);
+	wl_array_init(&pass->ops);
+
+	return &pass->base;
+}
+
+struct render_replay {
+	struct wlr_renderer *renderer;
+	struct wlr_allocator *allocator;
+	struct wl_array textures; // struct wlr_texture *, indexed by ID
+	struct wlr_buffer *buffer;
+	struct wlr_render_timer *timer;
+
+	struct wlr_render_pass *pass; // NULL outside of frames
+	struct wlr_render_replay_frame frame;
+};
+
+static int64_t get_now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static bool get_clip(const void *payload, uint32_t size, size_t rec_size,
+		uint32_t has_clip, uint32_t n_clip_rects, pixman_region32_t *clip) {
+	if (size != rec_size + (size_t)n_clip_rects * sizeof(pixman_box32_t)) {
+		return false;
+	}
+	if (!has_clip) {
+		return n_clip_rects == 0;
+	}
+	const pixman_box32_t *rects =
+		(const pixman_box32_t *)((const char *)payload + rec_size);
+	return pixman_region32_init_rects(clip, rects, n_clip_rects);
+}
+
+static bool replay_frame(struct render_replay *replay, const void *payload,
+		uint32_t size) {
+	const struct recording_frame *rec = payload;
+	if (replay->pass != NULL || size != sizeof(*rec) ||
+			rec->width <= 0 || rec->height <= 0) {
+		return false;
+	}
+
+	struct wlr_buffer *buffer = replay->buffer;
+	if (buffer == NULL || buffer->width != rec->width ||
+			buffer->height != rec->height) {
+		wlr_buffer_drop(buffer);
+		replay->buffer = NULL;
+
+		const struct wlr_drm_format_set *formats =
+			wlr_renderer_get_render_formats(replay->renderer);
+		const struct wlr_drm_format *format = NULL;
+		if (formats != NULL) {
+			format = wlr_drm_format_set_get(formats, DRM_FORMAT_XRGB8888);
+			if (format == NULL) {
+				format = wlr_drm_format_set_get(formats, DRM_FORMAT_ARGB8888);
+			}
+		}
+		if (format == NULL) {
+			wlr_log(WLR_ERROR, "Renderer doesn't support XRGB8888 nor ARGB8888");
+			return false;
+		}
+
+		replay->buffer = wlr_allocator_create_buffer(replay->allocator,
+			rec->width, rec->height, format);
+		if (replay->buffer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to allocate buffer");
+			return false;
+		}
+	}
+
+	replay->frame.width = rec->width;
+	replay->frame.height = rec->height;
+	replay->frame.ops = 0;
+
+	int64_t start = get_now_ns();
+	replay->pass = wlr_renderer_begin_buffer_pass(replay->renderer,
+		replay->buffer, &(struct wlr_buffer_pass_options){
+			.timer = replay->timer,
+		});
+	replay->frame.cpu_duration_ns = get_now_ns() - start;
+	return replay->pass != NULL;
+}
+
+static bool replay_texture(struct render_replay *replay, const void *payload,
+		uint32_t size) {
+	const struct recording_texture *rec = payload;
+	if (size < sizeof(*rec) || rec->width == 0 || rec->height == 0 ||
+			rec->id != replay->textures.size / sizeof(struct wlr_texture *)) {
+		return false;
+	}
+
+	const void *data = (const char *)payload + sizeof(*rec);
+	uint32_t format = rec->format, stride = rec->stride;
+	void *placeholder = NULL;
+	if (format == DRM_FORMAT_INVALID) {
+		// Use a grey texture of the same size, so that the workload stays
+		// representative
+		if (size != sizeof(*rec) || rec->width > max_record_size / 4 ||
+				(uint64_t)rec->width * 4 * rec->height > max_record_size) {
+			return false;
+		}
+		format = DRM_FORMAT_ARGB8888;
+		stride = rec->width * 4;
+		placeholder = malloc((size_t)stride * rec->height);
+		if (placeholder == NULL) {
+			return false;
+		}
+		memset(placeholder, 0x80, (size_t)stride * rec->height);
+		data = placeholder;
+	} else if (stride == 0 ||
+			size - sizeof(*rec) != (uint64_t)stride * rec->height) {
+		return false;
+	}
+
+	struct wlr_texture *texture = wlr_texture_from_pixels(replay->renderer,
+		format, stride, rec->width, rec->height, data);
+	free(placeholder);
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to upload texture %"PRIu32, rec->id);
+		return false;
+	}
+
+	struct wlr_texture **ptr = wl_array_add(&replay->textures, sizeof(texture));
+	if (ptr == NULL) {
+		wlr_texture_destroy(texture);
+		return false;
+	}
+	*ptr = texture;
+	return true;
+}
+
+static bool replay_add_texture(struct render_replay *replay,
+		const void *payload, uint32_t size) {
+	const struct recording_add_texture *rec = payload;
+	size_t textures_len = replay->textures.size / sizeof(struct wlr_texture *);
+	if (replay->pass == NULL || size < sizeof(*rec) ||
+			rec->texture_id >= textures_len) {
+		return false;
+	}
+
+	pixman_region32_t clip;
+	if (!get_clip(payload, size, sizeof(*rec), rec->has_clip,
+			rec->n_clip_rects, &clip)) {
+		return false;
+	}
+
+	struct wlr_texture **textures = replay->textures.data;
+	struct wlr_texture *texture = textures[rec->texture_id];
+	struct wlr_fbox src_box = {
+		.x = rec->src_x,
+		.y = rec->src_y,
+		.width = rec->src_width,
+		.height = rec->src_height,
+	};
+	if (!wlr_fbox_empty(&src_box) && (src_box.x < 0 || src_box.y < 0 ||
+			src_box.x + src_box.width > texture->width ||
+			src_box.y + src_box.height > texture->height)) {
+		if (rec->has_clip) {
+			pixman_region32_fini(&clip);
+		}
+		return false;
+	}
+
+	float alpha = rec->alpha;
+	int64_t start = get_now_ns();
+	wlr_render_pass_add_texture(replay->pass, &(struct wlr_render_texture_options){
+		.texture = texture,
+		.src_box = src_box,
+		.dst_box = {
+			.x = rec->dst_x,
+			.y = rec->dst_y,
+			.width = rec->dst_width,
+			.height = rec->dst_height,
+		},
+		.alpha = &alpha,
+		.clip = rec->has_clip ? &clip : NULL,
+		.transform = rec->transform,
+		.filter_mode = rec->filter_mode,
+		.blend_mode = rec->blend_mode,
+	});
+	replay->frame.cpu_duration_ns += get_now_ns() - start;
+	replay->frame.ops++;
+
+	if (rec->has_clip) {
+		pixman_region32_fini(&clip);
+	}
+	return true;
+}
+
+static bool replay_add_rect(struct render_replay *replay,
+		const void *payload, uint32_t size) {
+	const struct recording_add_rect *rec = payload;
+	if (replay->pass == NULL || size < sizeof(*rec) ||
+			rec->width < 0 || rec->height < 0) {
+		return false;
+	}
+
+	pixman_region32_t clip;
+	if (!get_clip(payload, size, sizeof(*rec), rec->has_clip,
+			rec->n_clip_rects, &clip)) {
+		return false;
+	}
+
+	int64_t start = get_now_ns();
+	wlr_render_pass_add_rect(replay->pass, &(struct wlr_render_rect_options){
+		.box = {
+			.x = rec->x,
+			.y = rec->y,
+			.width = rec->width,
+			.height = rec->height,
+		},
+		.color = {
+			.r = rec->r,
+			.g = rec->g,
+			.b = rec->b,
+			.a = rec->a,
+		},
+		.clip = rec->has_clip ? &clip : NULL,
+		.blend_mode = rec->blend_mode,
+	});
+	replay->frame.cpu_duration_ns += get_now_ns() - start;
+	replay->frame.ops++;
+
+	if (rec->has_clip) {
+		pixman_region32_fini(&clip);
+	}
+	return true;
+}
+
+static bool replay_submit(struct render_replay *replay, uint32_t size,
+		void (*frame_done)(const struct wlr_render_replay_frame *frame, void *data),
+		void *data) {
+	if (replay->pass == NULL || size != 0) {
+		return false;
+	}
+
+	int64_t start = get_now_ns();
+	bool ok = wlr_render_pass_submit(replay->pass);
+	replay->frame.cpu_duration_ns += get_now_ns() - start;
+	replay->pass = NULL;
+	if (!ok) {
+		wlr_log(WLR_ERROR, "Failed to submit render pass");
+		return false;
+	}
+
+	replay->frame.gpu_duration_ns = -1;
+	if (replay->timer != NULL) {
+		replay->frame.gpu_duration_ns =
+			wlr_render_timer_get_duration_ns(replay->timer);
+	}
+
+	if (frame_done != NULL) {
+		frame_done(&replay->frame, data);
+	}
+	replay->frame.index++;
+	return true;
+}
+
+bool wlr_render_recording_replay(FILE *f, struct wlr_renderer *renderer,
+		struct wlr_allocator *allocator,
+		void (*frame_done)(const struct wlr_render_replay_frame *frame, void *data),
+		void *data) {
+	struct recording_header header;
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+			memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0) {
+		wlr_log(WLR_ERROR, "Not a render recording");
+		return false;
+	}
+	if (header.version != RECORDING_VERSION) {
+		wlr_log(WLR_ERROR, "Unsupported render recording version %"PRIu32,
+			header.version);
+		return false;
+	}
+
+	struct render_replay replay = {
+		.renderer = renderer,
+		.allocator = allocator,
+		.timer = wlr_render_timer_create(renderer),
+	};
+	wl_array_init(&replay.textures);
+
+	bool ok = true;
+	void *payload = NULL;
+	while (ok) {
+		struct recording_record record;
+		if (fread(&record, sizeof(record), 1, f) != 1) {
+			// The recording may have been cut in the middle of a frame
+			ok = feof(f);
+			break;
+		}
+		if (record.size > max_record_size) {
+			ok = false;
+			break;
+		}
+
+		free(payload);
+		payload = malloc(record.size > 0 ? record.size : 1);
+		if (payload == NULL ||
+				(record.size > 0 && fread(payload, record.size, 1, f) != 1)) {
+			ok = false;
+			break;
+		}
+
+		switch ((enum recording_op)record.op) {
+		case RECORDING_OP_FRAME:
+			ok = replay_frame(&replay, payload, record.size);
+			break;
+		case RECORDING_OP_TEXTURE:
+			ok = replay_texture(&replay, payload, record.size);
+			break;
+		case RECORDING_OP_ADD_TEXTURE:
+			ok = replay_add_texture(&replay, payload, record.size);
+			break;
+		case RECORDING_OP_ADD_RECT:
+			ok = replay_add_rect(&replay, payload, record.size);
+			break;
+		case RECORDING_OP_SUBMIT:
+			ok = replay_submit(&replay, record.size, frame_done, data);
+			break;
+		default:
+			wlr_log(WLR_DEBUG, "Skipping unknown record %"PRIu32, record.op);
+			break;
+		}
+	}
+	free(payload);
+
+	if (!ok) {
+		wlr_log(WLR_ERROR, "Invalid render recording (frame %zu)",
+			replay.frame.index);
+	}
+
+	if (replay.pass != NULL) {
+		wlr_render_pass_submit(replay.pass);
+	}
+	struct wlr_texture **texture_ptr;
+	wl_array_for_each(texture_ptr, &replay.textures) {
+		wlr_texture_destroy(*texture_ptr);
+	}
+	wl_array_release(&replay.textures);
+	wlr_buffer_drop(replay.buffer);
+	if (replay.timer != NULL) {
+		wlr_render_timer_destroy(replay.timer);
+	}
+	return ok;
+}
@@ -5,6 +5,7 @@
 #include <wlr/types/wlr_buffer.h>
 #include "render/allocator/allocator.h"
 #include "render/drm_format_set.h"
+#include "util/time.h"
 
 static void swapchain_handle_allocator_destroy(struct wl_listener *listener,
 		void *data) {
@@ -78,21 +79,81 @@ static struct wlr_buffer *slot_acquire(struct wlr_swapchain *swapchain,
 		*age = slot->age;
 	}
 
+	slot->last_used_msec = get_current_time_msec();
+
 	return wlr_buffer_lock(slot->buffer);
 }
 
+// Check whether a slot needs less repainting than another one. The age of a
+// buffer is the number of frames its contents lag behind: the smaller, the less
+// damage has been accumulated since. An age of zero means the contents are
+// undefined.
+static bool slot_is_better(const struct wlr_swapchain_slot *slot,
+		const struct wlr_swapchain_slot *other) {
+	if (other == NULL) {
+		return true;
+	}
+	if (slot->age <= 0) {
+		return false;
+	}
+	return other->age <= 0 || slot->age < other->age;
+}
+
+// Find the free buffer which is the cheapest to repaint
+static struct wlr_swapchain_slot *swapchain_get_best_slot(
+		struct wlr_swapchain *swapchain) {
+	struct wlr_swapchain_slot *best_slot = NULL;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot->acquired || slot->buffer == NULL) {
+			continue;
+		}
+		if (slot_is_better(slot, best_slot)) {
+			best_slot = slot;
+		}
+	}
+	return best_slot;
+}
+
+static void swapchain_trim(struct wlr_swapchain *swapchain,
+		const struct wlr_swapchain_slot *keep) {
+	int64_t now = get_current_time_msec();
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+		if (slot == keep || slot->acquired || slot->buffer == NULL) {
+			continue;
+		}
+		if (now - slot->last_used_msec >= WLR_SWAPCHAIN_IDLE_TIMEOUT_MSEC) {
+			wlr_log(WLR_DEBUG, "Releasing idle swapchain buffer");
+			slot_reset(slot);
+		}
+	}
+}
+
+void wlr_swapchain_trim(struct wlr_swapchain *swapchain) {
+	swapchain_trim(swapchain, swapchain_get_best_slot(swapchain));
+}
+
 struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
 		int *age) {
+	struct wlr_swapchain_slot *best_slot = swapchain_get_best_slot(swapchain);
+
+	// Buffers which are only needed during bursts of activity (e.g. when
+	// the previous frame is still being displayed) are released once the
+	// content is static again
+	swapchain_trim(swapchain, best_slot);
+
+	if (best_slot != NULL) {
+		return slot_acquire(swapchain, best_slot, age);
+	}
+
 	struct wlr_swapchain_slot *free_slot = NULL;
 	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
 		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
-		if (slot->acquired) {
-			continue;
-		}
-		if (slot->buffer != NULL) {
-			return slot_acquire(swapchain, slot, age);
+		if (!slot->acquired && slot->buffer == NULL) {
+			free_slot = slot;
+			break;
 		}
-		free_slot = slot;
 	}
 	if (free_slot == NULL) {
 		wlr_log(WLR_ERROR, "No free output buffer slot");
@@ -0,0 +1,306 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vulkan/vulkan.h>
+#include <wlr/util/log.h>
+#include "render/vulkan.h"
+#include "util/env.h"
+
+// The Vulkan driver already validates the data it is handed back, but some
+// drivers have been known to crash on stale caches. Prefix the data with our
+// own header so that we never feed a driver a cache produced by another
+// device or another driver build.
+#define PIPELINE_CACHE_MAGIC 0x43504b56524c57 // "WLRVKPC"
+#define PIPELINE_CACHE_VERSION 1
+
+static const uint64_t max_pipeline_cache_size = 64 * 1024 * 1024; // 64MB
+
+struct wlr_vk_pipeline_cache_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t device_uuid[VK_UUID_SIZE];
+	uint8_t driver_uuid[VK_UUID_SIZE];
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+	uint64_t data_size;
+};
+
+static void get_cache_header(struct wlr_vk_device *dev,
+		struct wlr_vk_pipeline_cache_header *header) {
+	VkPhysicalDeviceIDProperties id_props = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+	};
+	VkPhysicalDeviceProperties2 props = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &id_props,
+	};
+	vkGetPhysicalDeviceProperties2(dev->phdev, &props);
+
+	*header = (struct wlr_vk_pipeline_cache_header){
+		.magic = PIPELINE_CACHE_MAGIC,
+		.version = PIPELINE_CACHE_VERSION,
+		.vendor_id = props.properties.vendorID,
+		.device_id = props.properties.deviceID,
+		.driver_version = props.properties.driverVersion,
+	};
+	memcpy(header->device_uuid, id_props.deviceUUID, VK_UUID_SIZE);
+	memcpy(header->driver_uuid, id_props.driverUUID, VK_UUID_SIZE);
+	memcpy(header->pipeline_cache_uuid, props.properties.pipelineCacheUUID,
+		VK_UUID_SIZE);
+}
+
+static char *get_cache_dir(void) {
+	const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+	if (xdg_cache_home != NULL && xdg_cache_home[0] == '/') {
+		size_t len = snprintf(NULL, 0, "%s/wlroots", xdg_cache_home) + 1;
+		char *dir = malloc(len);
+		if (dir == NULL) {
+			return NULL;
+		}
+		snprintf(dir, len, "%s/wlroots", xdg_cache_home);
+		return dir;
+	}
+
+	const char *home = getenv("HOME");
+	if (home == NULL || home[0] != '/') {
+		return NULL;
+	}
+	size_t len = snprintf(NULL, 0, "%s/.cache/wlroots", home) + 1;
+	char *dir = malloc(len);
+	if (dir == NULL) {
+		return NULL;
+	}
+	snprintf(dir, len, "%s/.cache/wlroots", home);
+	return dir;
+}
+
+static bool ensure_dir(const char *path) {
+	if (mkdir(path, 0700) == 0 || errno == EEXIST) {
+		return true;
+	}
+	if (errno != ENOENT) {
+		wlr_log_errno(WLR_DEBUG, "Failed to create directory %s", path);
+		return false;
+	}
+
+	// Create the parent directory (usually ~/.cache) first
+	char *parent = strdup(path);
+	if (parent == NULL) {
+		return false;
+	}
+	char *sep = strrchr(parent, '/');
+	bool ok = sep != NULL && sep != parent;
+	if (ok) {
+		*sep = '\0';
+		ok = ensure_dir(parent);
+	}
+	free(parent);
+
+	if (!ok) {
+		return false;
+	}
+	if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+		wlr_log_errno(WLR_DEBUG, "Failed to create directory %s", path);
+		return false;
+	}
+	return true;
+}
+
+static char *get_cache_path(const struct wlr_vk_pipeline_cache_header *header) {
+	char *dir = get_cache_dir();
+	if (dir == NULL) {
+		return NULL;
+	}
+
+	char uuid[2 * VK_UUID_SIZE + 1];
+	for (size_t i = 0; i < VK_UUID_SIZE; i++) {
+		snprintf(&uuid[2 * i], 3, "%02x", header->device_uuid[i]);
+	}
+
+	size_t len = snprintf(NULL, 0, "%s/vulkan-pipeline-cache-%s", dir, uuid) + 1;
+	char *path = malloc(len);
+	if (path != NULL) {
+		snprintf(path, len, "%s/vulkan-pipeline-cache-%s", dir, uuid);
+	}
+	free(dir);
+	return path;
+}
+
+static void *load_cache_data(const char *path,
+		const struct wlr_vk_pipeline_cache_header *expected, size_t *size) {
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		if (errno != ENOENT) {
+			wlr_log_errno(WLR_DEBUG, "Failed to open %s", path);
+		}
+		return NULL;
+	}
+
+	void *data = NULL;
+	struct wlr_vk_pipeline_cache_header header;
+	if (fread(&header, sizeof(header), 1, f) != 1) {
+		wlr_log(WLR_DEBUG, "Pipeline cache %s is truncated", path);
+		goto out;
+	}
+
+	struct wlr_vk_pipeline_cache_header cmp = header;
+	cmp.data_size = 0;
+	if (memcmp(&cmp, expected, sizeof(cmp)) != 0) {
+		wlr_log(WLR_DEBUG, "Pipeline cache %s was created by a different "
+			"device or driver, ignoring it", path);
+		goto out;
+	}
+
+	if (header.data_size == 0 || header.data_size > max_pipeline_cache_size) {
+		goto out;
+	}
+	data = malloc(header.data_size);
+	if (data == NULL) {
+		goto out;
+	}
+	if (fread(data, header.data_size, 1, f) != 1) {
+		wlr_log(WLR_DEBUG, "Pipeline cache %s is truncated", path);
+		free(data);
+		data = NULL;
+		goto out;
+	}
+	*size = header.data_size;
+
+out:
+	fclose(f);
+	return data;
+}
+
+void vulkan_pipeline_cache_init(struct wlr_vk_renderer *renderer) {
+	renderer->pipeline_cache = VK_NULL_HANDLE;
+	renderer->pipeline_cache_path = NULL;
+	renderer->pipeline_cache_dirty = false;
+
+	if (env_parse_bool("WLR_RENDERER_VK_NO_PIPELINE_CACHE")) {
+		return;
+	}
+
+	struct wlr_vk_pipeline_cache_header header;
+	get_cache_header(renderer->dev, &header);
+
+	size_t data_size = 0;
+	void *data = NULL;
+	char *path = get_cache_path(&header);
+	if (path != NULL) {
+		data = load_cache_data(path, &header, &data_size);
+	}
+
+	VkPipelineCacheCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = data_size,
+		.pInitialData = data,
+	};
+	VkResult res = vkCreatePipelineCache(renderer->dev->dev, &info, NULL,
+		&renderer->pipeline_cache);
+	if (res != VK_SUCCESS && data != NULL) {
+		// Retry without the on-disk data
+		wlr_vk_error("vkCreatePipelineCache", res);
+		info.initialDataSize = 0;
+		info.pInitialData = NULL;
+		res = vkCreatePipelineCache(renderer->dev->dev, &info, NULL,
+			&renderer->pipeline_cache);
+	}
+	free(data);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkCreatePipelineCache", res);
+		free(path);
+		renderer->pipeline_cache = VK_NULL_HANDLE;
+		return;
+	}
+
+	if (data_size > 0) {
+		wlr_log(WLR_DEBUG, "Loaded %zu bytes of Vulkan pipeline cache from %s",
+			data_size, path);
+	}
+
+	renderer->pipeline_cache_path = path;
+}
+
+void vulkan_pipeline_cache_save(struct wlr_vk_renderer *renderer) {
+	if (renderer->pipeline_cache == VK_NULL_HANDLE ||
+			renderer->pipeline_cache_path == NULL ||
+			!renderer->pipeline_cache_dirty) {
+		return;
+	}
+	renderer->pipeline_cache_dirty = false;
+
+	VkDevice dev = renderer->dev->dev;
+	size_t data_size = 0;
+	VkResult res = vkGetPipelineCacheData(dev, renderer->pipeline_cache,
+		&data_size, NULL);
+	if (res != VK_SUCCESS || data_size == 0) {
+		return;
+	}
+	void *data = malloc(data_size);
+	if (data == NULL) {
+		return;
+	}
+	res = vkGetPipelineCacheData(dev, renderer->pipeline_cache, &data_size, data);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkGetPipelineCacheData", res);
+		free(data);
+		return;
+	}
+
+	struct wlr_vk_pipeline_cache_header header;
+	get_cache_header(renderer->dev, &header);
+	header.data_size = data_size;
+
+	char *dir = get_cache_dir();
+	if (dir == NULL || !ensure_dir(dir)) {
+		goto out_dir;
+	}
+
+	// Write to a temporary file first so that concurrent compositors never
+	// read a partially written cache
+	const char *path = renderer->pipeline_cache_path;
+	size_t tmp_len = snprintf(NULL, 0, "%s.%d.tmp", path, (int)getpid()) + 1;
+	char *tmp_path = malloc(tmp_len);
+	if (tmp_path == NULL) {
+		goto out_dir;
+	}
+	snprintf(tmp_path, tmp_len, "%s.%d.tmp", path, (int)getpid());
+
+	FILE *f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		wlr_log_errno(WLR_DEBUG, "Failed to open %s", tmp_path);
+		goto out_tmp_path;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(data, data_size, 1, f) == 1;
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+	if (!ok || rename(tmp_path, path) != 0) {
+		wlr_log_errno(WLR_DEBUG, "Failed to write pipeline cache %s", path);
+		unlink(tmp_path);
+		goto out_tmp_path;
+	}
+
+	wlr_log(WLR_DEBUG, "Saved %zu bytes of Vulkan pipeline cache to %s",
+		data_size, path);
+
+out_tmp_path:
+	free(tmp_path);
+out_dir:
+	free(dir);
+	free(data);
+}
+
+void vulkan_pipeline_cache_finish(struct wlr_vk_renderer *renderer) {
+	vulkan_pipeline_cache_save(renderer);
+	if (renderer->pipeline_cache != VK_NULL_HANDLE) {
+		vkDestroyPipelineCache(renderer->dev->dev, renderer->pipeline_cache, NULL);
+	}
+	free(renderer->pipeline_cache_path);
+}
@@ -26,11 +26,9 @@
 #include "render/vulkan/shaders/output.frag.h"
 #include "types/wlr_buffer.h"
 #include "types/wlr_matrix.h"
+#include "util/array.h"
 
 // TODO:
-// - simplify stage allocation, don't track allocations but use ringbuffer-like
-// - use a pipeline cache (not sure when to save though, after every pipeline
-//   creation?)
 // - create pipelines as derivatives of each other
 // - evaluate if creating VkDeviceMemory pools is a good idea.
 //   We can expect wayland client images to be fairly large (and shouldn't
@@ -171,12 +169,15 @@ static void shared_buffer_destroy(struct wlr_vk_renderer *r,
 		return;
 	}
 
-	if (buffer->allocs.size > 0) {
-		wlr_log(WLR_ERROR, "shared_buffer_finish: %zu allocations left",
-			buffer->allocs.size / sizeof(struct wlr_vk_allocation));
+	if (buffer->pending || buffer->watermarks.size > 0) {
+		wlr_log(WLR_ERROR, "shared_buffer_finish: %zu submissions in flight",
+			buffer->watermarks.size / sizeof(struct wlr_vk_stage_watermark));
 	}
 
-	wl_array_release(&buffer->allocs);
+	wl_array_release(&buffer->watermarks);
+	if (buffer->cpu_mapping) {
+		vkUnmapMemory(r->dev->dev, buffer->memory);
+	}
 	if (buffer->buffer) {
 		vkDestroyBuffer(r->dev->dev, buffer->buffer, NULL);
 	}
@@ -188,76 +189,119 @@ static void shared_buffer_destroy(struct wlr_vk_renderer *r,
 	free(buffer);
 }
 
-struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
-		VkDeviceSize size, VkDeviceSize alignment) {
-	// try to find free span
-	// simple greedy allocation algorithm - should be enough for this usecase
-	// since all allocations are freed together after the frame
-	struct wlr_vk_shared_buffer *buf;
-	wl_list_for_each_reverse(buf, &r->stage.buffers, link) {
-		VkDeviceSize start = 0u;
-		if (buf->allocs.size > 0) {
-			const struct wlr_vk_allocation *allocs = buf->allocs.data;
-			size_t allocs_len = buf->allocs.size / sizeof(struct wlr_vk_allocation);
-			const struct wlr_vk_allocation *last = &allocs[allocs_len - 1];
-			start = last->start + last->size;
-		}
-
-		assert(start <= buf->buf_size);
-
-		// ensure the proposed start is a multiple of alignment
-		start += alignment - 1 - ((start + alignment - 1) % alignment);
+static bool shared_buffer_is_idle(struct wlr_vk_shared_buffer *buf) {
+	return !buf->pending && buf->watermarks.size == 0;
+}
 
-		if (buf->buf_size - start < size) {
-			continue;
+// Tries to allocate a span at the head of the ring. The range [tail, head)
+// is in use, and wraps around the end of the buffer if head < tail. head ==
+// tail means that the ring is empty.
+static bool shared_buffer_alloc(struct wlr_vk_shared_buffer *buf,
+		VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *start) {
+	if (shared_buffer_is_idle(buf)) {
+		buf->head = buf->tail = 0;
+	}
+
+	// ensure the proposed start is a multiple of alignment
+	VkDeviceSize aligned_head = buf->head;
+	aligned_head += alignment - 1 - ((aligned_head + alignment - 1) % alignment);
+
+	if (buf->head >= buf->tail) {
+		if (aligned_head <= buf->buf_size && buf->buf_size - aligned_head >= size) {
+			*start = aligned_head;
+		} else if (size < buf->tail) {
+			// Wrap around, the end of the buffer is left unused until the
+			// tail reaches it
+			*start = 0;
+		} else {
+			return false;
 		}
-
-		struct wlr_vk_allocation *a = wl_array_add(&buf->allocs, sizeof(*a));
-		if (a == NULL) {
-			wlr_log_errno(WLR_ERROR, "Allocation failed");
-			goto error_alloc;
+	} else {
+		// Never let head catch up with tail, since that means empty
+		if (aligned_head >= buf->tail || buf->tail - aligned_head <= size) {
+			return false;
 		}
+		*start = aligned_head;
+	}
 
-		*a = (struct wlr_vk_allocation){
-			.start = start,
-			.size = size,
-		};
-		return (struct wlr_vk_buffer_span) {
-			.buffer = buf,
-			.alloc = *a,
-		};
+	buf->head = *start + size;
+	buf->pending = true;
+	return true;
+}
+
+static void shared_buffer_retire(struct wlr_vk_shared_buffer *buf,
+		uint64_t current_point) {
+	const struct wlr_vk_stage_watermark *marks = buf->watermarks.data;
+	size_t marks_len = buf->watermarks.size / sizeof(*marks);
+	size_t retired = 0;
+	while (retired < marks_len && marks[retired].timeline_point <= current_point) {
+		buf->tail = marks[retired].head;
+		retired++;
 	}
+	array_remove_at(&buf->watermarks, 0, retired * sizeof(*marks));
 
-	if (size > max_stage_size) {
-		wlr_log(WLR_ERROR, "cannot vulkan stage buffer: "
-			"requested size (%zu bytes) exceeds maximum (%zu bytes)",
-			(size_t)size, (size_t)max_stage_size);
-		goto error_alloc;
+	if (shared_buffer_is_idle(buf)) {
+		buf->head = buf->tail = 0;
 	}
+}
+
+// The current ring is the most recently created one. Older rings are only
+// kept around until the GPU is done with them.
+static struct wlr_vk_shared_buffer *get_current_stage_buffer(
+		struct wlr_vk_renderer *r) {
+	if (wl_list_empty(&r->stage.buffers)) {
+		return NULL;
+	}
+	struct wlr_vk_shared_buffer *buf =
+		wl_container_of(r->stage.buffers.next, buf, link);
+	return buf->dedicated ? NULL : buf;
+}
+
+void vulkan_stage_retire(struct wlr_vk_renderer *r, uint64_t current_point) {
+	struct wlr_vk_shared_buffer *current = get_current_stage_buffer(r);
 
-	// we didn't find a free buffer - create one
-	// size = clamp(max(size * 2, prev_size * 2), min_size, max_size)
-	VkDeviceSize bsize = size * 2;
-	bsize = bsize < min_stage_size ? min_stage_size : bsize;
-	if (!wl_list_empty(&r->stage.buffers)) {
-		struct wl_list *last_link = r->stage.buffers.prev;
-		struct wlr_vk_shared_buffer *prev = wl_container_of(
-			last_link, prev, link);
-		VkDeviceSize last_size = 2 * prev->buf_size;
-		bsize = bsize < last_size ? last_size : bsize;
+	struct wlr_vk_shared_buffer *buf, *buf_tmp;
+	wl_list_for_each_safe(buf, buf_tmp, &r->stage.buffers, link) {
+		shared_buffer_retire(buf, current_point);
+		if (buf != current && shared_buffer_is_idle(buf)) {
+			shared_buffer_destroy(r, buf);
+		}
 	}
+}
+
+void vulkan_stage_mark_submitted(struct wlr_vk_renderer *r,
+		uint64_t timeline_point) {
+	struct wlr_vk_shared_buffer *buf;
+	wl_list_for_each(buf, &r->stage.buffers, link) {
+		if (!buf->pending) {
+			continue;
+		}
 
-	if (bsize > max_stage_size) {
-		wlr_log(WLR_INFO, "vulkan stage buffers have reached max size");
-		bsize = max_stage_size;
+		struct wlr_vk_stage_watermark *mark =
+			wl_array_add(&buf->watermarks, sizeof(*mark));
+		if (mark == NULL) {
+			// Keep the allocations pending, they'll be retired with the
+			// next submission instead
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			continue;
+		}
+		*mark = (struct wlr_vk_stage_watermark){
+			.timeline_point = timeline_point,
+			.head = buf->head,
+		};
+		buf->pending = false;
 	}
+}
 
-	// create buffer
-	buf = calloc(1, sizeof(*buf));
+static struct wlr_vk_shared_buffer *shared_buffer_create(
+		struct wlr_vk_renderer *r, VkDeviceSize bsize) {
+	struct wlr_vk_shared_buffer *buf = calloc(1, sizeof(*buf));
 	if (!buf) {
 		wlr_log_errno(WLR_ERROR, "Allocation failed");
-		goto error_alloc;
+		return NULL;
 	}
+	wl_list_init(&buf->link);
+	wl_array_init(&buf->watermarks);
 
 	VkResult res;
 	VkBufferCreateInfo buf_info = {
@@ -301,29 +345,103 @@ struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
 		goto error;
 	}
 
-	struct wlr_vk_allocation *a = wl_array_add(&buf->allocs, sizeof(*a));
-	if (a == NULL) {
-		wlr_log_errno(WLR_ERROR, "Allocation failed");
+	// The memory is host-coherent, keep it mapped for the whole lifetime of
+	// the buffer
+	res = vkMapMemory(r->dev->dev, buf->memory, 0, VK_WHOLE_SIZE, 0,
+		&buf->cpu_mapping);
+	if (res != VK_SUCCESS) {
+		wlr_vk_error("vkMapMemory", res);
+		buf->cpu_mapping = NULL;
 		goto error;
 	}
 
 	wlr_log(WLR_DEBUG, "Created new vk staging buffer of size %" PRIu64, bsize);
 	buf->buf_size = bsize;
-	wl_list_insert(&r->stage.buffers, &buf->link);
+	return buf;
 
-	*a = (struct wlr_vk_allocation){
-		.start = 0,
-		.size = size,
-	};
+error:
+	shared_buffer_destroy(r, buf);
+	return NULL;
+}
+
+struct wlr_vk_buffer_span vulkan_get_stage_span(struct wlr_vk_renderer *r,
+		VkDeviceSize size, VkDeviceSize alignment) {
+	VkDeviceSize start;
+	struct wlr_vk_shared_buffer *buf = get_current_stage_buffer(r);
+	if (buf != NULL) {
+		if (shared_buffer_alloc(buf, size, alignment, &start)) {
+			goto out;
+		}
+
+		// The ring is full: reclaim space from finished submissions and
+		// retry before growing
+		uint64_t current_point;
+		VkResult res = r->dev->api.vkGetSemaphoreCounterValueKHR(r->dev->dev,
+			r->timeline_semaphore, &current_point);
+		if (res != VK_SUCCESS) {
+			wlr_vk_error("vkGetSemaphoreCounterValueKHR", res);
+			goto error;
+		}
+		vulkan_stage_retire(r, current_point);
+		if (shared_buffer_alloc(buf, size, alignment, &start)) {
+			goto out;
+		}
+	}
+
+	if (size > max_stage_size) {
+		// Too large for a ring: use a dedicated buffer which is destroyed
+		// as soon as the upload has completed
+		wlr_log(WLR_DEBUG, "Requested staging size (%zu bytes) exceeds "
+			"maximum ring size (%zu bytes), using a dedicated buffer",
+			(size_t)size, (size_t)max_stage_size);
+		buf = shared_buffer_create(r, size);
+		if (buf == NULL) {
+			goto error;
+		}
+		buf->dedicated = true;
+		wl_list_insert(r->stage.buffers.prev, &buf->link);
+	} else {
+		// Replace the current ring with a bigger one. The old ring is
+		// destroyed once all of its submissions have completed.
+		// size = clamp(max(size * 2, prev_size * 2), min_size, max_size)
+		VkDeviceSize bsize = size * 2;
+		bsize = bsize < min_stage_size ? min_stage_size : bsize;
+		struct wlr_vk_shared_buffer *prev = get_current_stage_buffer(r);
+		if (prev != NULL) {
+			VkDeviceSize last_size = 2 * prev->buf_size;
+			bsize = bsize < last_size ? last_size : bsize;
+		}
+
+		if (bsize > max_stage_size) {
+			wlr_log(WLR_INFO, "vulkan stage buffers have reached max size");
+			bsize = max_stage_size;
+		}
+
+		buf = shared_buffer_create(r, bsize);
+		if (buf == NULL) {
+			goto error;
+		}
+		wl_list_insert(&r->stage.buffers, &buf->link);
+
+		if (prev != NULL && shared_buffer_is_idle(prev)) {
+			shared_buffer_destroy(r, prev);
+		}
+	}
+
+	if (!shared_buffer_alloc(buf, size, alignment, &start)) {
+		goto error;
+	}
+
+out:
 	return (struct wlr_vk_buffer_span) {
 		.buffer = buf,
-		.alloc = *a,
+		.alloc = (struct wlr_vk_allocation) {
+			.start = start,
+			.size = size,
+		},
 	};
 
 error:
-	shared_buffer_destroy(r, buf);
-
-error_alloc:
 	return (struct wlr_vk_buffer_span) {
 		.buffer = NULL,
 		.alloc = (struct wlr_vk_allocation) {0, 0},
@@ -380,6 +498,7 @@ bool vulkan_submit_stage_wait(struct wlr_vk_renderer *renderer) {
 
 	// NOTE: don't release stage allocations here since they may still be
 	// used for reading. Will be done next frame.
+	vulkan_stage_mark_submitted(renderer, timeline_point);
 
 	return vulkan_wait_command_buffer(cb, renderer);
 }
@@ -415,7 +534,6 @@ static bool init_command_buffer(struct wlr_vk_command_buffer *cb,
 		.vk = vk_cb,
 	};
 	wl_list_init(&cb->destroy_textures);
-	wl_list_init(&cb->stage_buffers);
 	return true;
 }
 
@@ -448,14 +566,6 @@ static void release_command_buffer_resources(struct wlr_vk_command_buffer *cb,
 		texture->last_used_cb = NULL;
 		wlr_texture_destroy(&texture->wlr_texture);
 	}
-
-	struct wlr_vk_shared_buffer *buf, *buf_tmp;
-	wl_list_for_each_safe(buf, buf_tmp, &cb->stage_buffers, link) {
-		buf->allocs.size = 0;
-
-		wl_list_remove(&buf->link);
-		wl_list_insert(&renderer->stage.buffers, &buf->link);
-	}
 }
 
 static struct wlr_vk_command_buffer *get_command_buffer(
@@ -479,6 +589,9 @@ static struct wlr_vk_command_buffer *get_command_buffer(
 		}
 	}
 
+	// Reclaim staging memory used by completed submissions
+	vulkan_stage_retire(renderer, current_point);
+
 	// First try to find an existing command buffer which isn't busy
 	struct wlr_vk_command_buffer *unused = NULL;
 	struct wlr_vk_command_buffer *wait = NULL;
@@ -999,6 +1112,9 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 		}
 	}
 
+	// The device is idle, so all stage submissions have completed
+	vulkan_stage_retire(renderer, UINT64_MAX);
+
 	// stage.cb automatically freed with command pool
 	struct wlr_vk_shared_buffer *buf, *tmp_buf;
 	wl_list_for_each_safe(buf, tmp_buf, &renderer->stage.buffers, link) {
@@ -1046,6 +1162,8 @@ static void vulkan_destroy(struct wlr_renderer *wlr_renderer) {
 		vkDestroySamplerYcbcrConversion(dev->dev, pipeline_layout->ycbcr.conversion, NULL);
 	}
 
+	vulkan_pipeline_cache_finish(renderer);
+
 	vkDestroySemaphore(dev->dev, renderer->timeline_semaphore, NULL);
 	vkDestroyPipelineLayout(dev->dev, renderer->output_pipe_layout, NULL);
 	vkDestroyDescriptorSetLayout(dev->dev, renderer->output_ds_layout, NULL);
@@ -1633,13 +1751,14 @@ struct wlr_vk_pipeline *setup_get_or_create_pipeline(
 		.pVertexInputState = &vertex,
 	};
 
-	VkPipelineCache cache = VK_NULL_HANDLE;
-	res = vkCreateGraphicsPipelines(dev, cache, 1, &pinfo, NULL, &pipeline->vk);
+	res = vkCreateGraphicsPipelines(dev, renderer->pipeline_cache, 1, &pinfo,
+		NULL, &pipeline->vk);
 	if (res != VK_SUCCESS) {
 		wlr_vk_error("failed to create vulkan pipelines:", res);
 		free(pipeline);
 		return NULL;
 	}
+	renderer->pipeline_cache_dirty = true;
 
 	wl_list_insert(&setup->pipelines, &pipeline->link);
 	return pipeline;
@@ -1735,12 +1854,13 @@ static bool init_blend_to_output_pipeline(struct wlr_vk_renderer *renderer,
 		.pVertexInputState = &vertex,
 	};
 
-	VkPipelineCache cache = VK_NULL_HANDLE;
-	res = vkCreateGraphicsPipelines(dev, cache, 1, &pinfo, NULL, pipe);
+	res = vkCreateGraphicsPipelines(dev, renderer->pipeline_cache, 1, &pinfo,
+		NULL, pipe);
 	if (res != VK_SUCCESS) {
 		wlr_vk_error("failed to create vulkan pipelines:", res);
 		return false;
 	}
+	renderer->pipeline_cache_dirty = true;
 
 	return true;
 }
@@ -2137,6 +2257,12 @@ static struct wlr_vk_render_format_setup *find_or_create_render_setup(
 	}
 
 	wl_list_insert(&renderer->render_format_setups, &setup->link);
+
+	// New render format setups are mostly created on startup and output
+	// configuration changes: persist the pipelines right away so that
+	// the next start doesn't need to compile them again
+	vulkan_pipeline_cache_save(renderer);
+
 	return setup;
 
 error:
@@ -2163,6 +2289,8 @@ struct wlr_renderer *vulkan_renderer_create_for_device(struct wlr_vk_device *dev
 	wl_list_init(&renderer->render_buffers);
 	wl_list_init(&renderer->pipeline_layouts);
 
+	vulkan_pipeline_cache_init(renderer);
+
 	if (!init_static_render_data(renderer)) {
 		goto error;
 	}
@@ -12,6 +12,7 @@
 #include <xf86drm.h>
 #include "render/pixel_format.h"
 #include "render/vulkan.h"
+#include "types/wlr_shm.h"
 
 static const struct wlr_texture_impl texture_impl;
 
@@ -41,9 +42,7 @@ static bool write_pixels(struct wlr_vk_texture *texture,
 		uint32_t stride, const pixman_region32_t *region, const void *vdata,
 		VkImageLayout old_layout, VkPipelineStageFlags src_stage,
 		VkAccessFlags src_access) {
-	VkResult res;
 	struct wlr_vk_renderer *renderer = texture->renderer;
-	VkDevice dev = texture->renderer->dev->dev;
 
 	const struct wlr_pixel_format_info *format_info = drm_get_pixel_format_info(texture->format->drm);
 	assert(format_info);
@@ -80,19 +79,12 @@ static bool write_pixels(struct wlr_vk_texture *texture,
 		return false;
 	}
 
-	void *vmap;
-	res = vkMapMemory(dev, span.buffer->memory, span.alloc.start,
-		bsize, 0, &vmap);
-	if (res != VK_SUCCESS) {
-		wlr_vk_error("vkMapMemory", res);
-		free(copies);
-		return false;
-	}
-	char *map = (char *)vmap;
+	char *vmap = (char *)span.buffer->cpu_mapping + span.alloc.start;
+	char *map = vmap;
 
 	// upload data
 
-	uint32_t buf_off = span.alloc.start + (map - (char *)vmap);
+	uint32_t buf_off = span.alloc.start + (map - vmap);
 	for (int i = 0; i < rects_len; i++) {
 		pixman_box32_t rect = rects[i];
 		uint32_t width = rect.x2 - rect.x1;
@@ -137,8 +129,7 @@ static bool write_pixels(struct wlr_vk_texture *texture,
 		buf_off += height * packed_stride;
 	}
 
-	assert((uint32_t)(map - (char *)vmap) == bsize);
-	vkUnmapMemory(dev, span.buffer->memory);
+	assert((uint32_t)(map - vmap) == bsize);
 
 	// record staging cb
 	// will be executed before next frame
@@ -824,8 +815,16 @@ struct wlr_texture *vulkan_texture_from_buffer(struct wlr_renderer *wlr_renderer
 	size_t stride;
 	struct wlr_dmabuf_attributes dmabuf;
 	if (wlr_buffer_get_dmabuf(buffer, &dmabuf)) {
-		return vulkan_texture_from_dmabuf_buffer(renderer, buffer, &dmabuf);
-	} else if (wlr_buffer_begin_data_ptr_access(buffer,
+		struct wlr_texture *tex = vulkan_texture_from_dmabuf_buffer(renderer, buffer, &dmabuf);
+		shm_buffer_report_dmabuf_import(buffer, tex != NULL);
+		if (tex != NULL) {
+			return tex;
+		}
+		// Buffers may expose both a DMA-BUF and CPU access (e.g. shared
+		// memory wrapped via udmabuf): fall back to an upload
+	}
+
+	if (wlr_buffer_begin_data_ptr_access(buffer,
 			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
 		struct wlr_texture *tex = vulkan_texture_from_pixels(renderer,
 			format, stride, buffer->width, buffer->height, data);
@@ -1,9 +1,28 @@
 #include <assert.h>
+#include <drm_fourcc.h>
 #include <stdlib.h>
 #include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/render/interface.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
+#include "render/pixel_format.h"
 #include "types/wlr_buffer.h"
+#include "types/wlr_shm.h"
+#include "util/time.h"
+
+// Maximum number of idle textures kept in a pool
+#define CLIENT_BUFFER_POOL_CAP 8
+// Idle textures are destroyed after this delay
+#define CLIENT_BUFFER_POOL_IDLE_MSEC 1000
+
+struct wlr_client_buffer_pool_texture {
+	struct wlr_texture *texture;
+	uint32_t format;
+	uint64_t history_id;
+	uint32_t history_seq;
+	int64_t released_msec;
+	struct wl_list link; // wlr_client_buffer_pool.textures, newest first
+};
 
 static const struct wlr_buffer_impl client_buffer_impl;
 
@@ -22,10 +41,103 @@ static struct wlr_client_buffer *client_buffer_from_buffer(
 	return client_buffer;
 }
 
+static void pool_texture_destroy(struct wlr_client_buffer_pool *pool,
+		struct wlr_client_buffer_pool_texture *pool_tex) {
+	wl_list_remove(&pool_tex->link);
+	pool->textures_len--;
+	wlr_texture_destroy(pool_tex->texture);
+	free(pool_tex);
+}
+
+static void pool_unref(struct wlr_client_buffer_pool *pool) {
+	assert(pool->n_refs > 0);
+	pool->n_refs--;
+	if (pool->n_refs == 0) {
+		assert(pool->textures_len == 0);
+		free(pool);
+	}
+}
+
+// Textures which can't be updated (e.g. pixman ones) reference the source
+// buffer instead of holding a copy of its contents
+static bool texture_holds_copy(struct wlr_texture *texture) {
+	return texture->impl->update_from_buffer != NULL;
+}
+
+static void pool_arm_trim_timer(struct wlr_client_buffer_pool *pool) {
+	if (wl_list_empty(&pool->textures)) {
+		return;
+	}
+	struct wlr_client_buffer_pool_texture *oldest =
+		wl_container_of(pool->textures.prev, oldest, link);
+	int64_t delay = oldest->released_msec + CLIENT_BUFFER_POOL_IDLE_MSEC -
+		get_current_time_msec();
+	// A zero delay would disarm the timer
+	wl_event_source_timer_update(pool->trim_timer, delay > 0 ? delay : 1);
+}
+
+static int pool_handle_trim_timer(void *data) {
+	struct wlr_client_buffer_pool *pool = data;
+	int64_t now = get_current_time_msec();
+	while (!wl_list_empty(&pool->textures)) {
+		struct wlr_client_buffer_pool_texture *oldest =
+			wl_container_of(pool->textures.prev, oldest, link);
+		if (now - oldest->released_msec < CLIENT_BUFFER_POOL_IDLE_MSEC) {
+			break;
+		}
+		pool_texture_destroy(pool, oldest);
+	}
+	pool_arm_trim_timer(pool);
+	return 0;
+}
+
+// Takes ownership of the client buffer's texture, if any
+static void pool_recycle(struct wlr_client_buffer_pool *pool,
+		struct wlr_client_buffer *client_buffer) {
+	struct wlr_texture *texture = client_buffer->texture;
+	if (texture == NULL) {
+		return;
+	}
+	client_buffer->texture = NULL;
+
+	if (pool->renderer == NULL || client_buffer->format == DRM_FORMAT_INVALID ||
+			!texture_holds_copy(texture)) {
+		wlr_texture_destroy(texture);
+		return;
+	}
+
+	struct wlr_client_buffer_pool_texture *pool_tex = calloc(1, sizeof(*pool_tex));
+	if (pool_tex == NULL) {
+		wlr_texture_destroy(texture);
+		return;
+	}
+	pool_tex->texture = texture;
+	pool_tex->format = client_buffer->format;
+	pool_tex->history_id = client_buffer->history_id;
+	pool_tex->history_seq = client_buffer->history_seq;
+	pool_tex->released_msec = get_current_time_msec();
+	bool was_empty = wl_list_empty(&pool->textures);
+	wl_list_insert(&pool->textures, &pool_tex->link);
+	pool->textures_len++;
+	if (was_empty) {
+		pool_arm_trim_timer(pool);
+	}
+
+	if (pool->textures_len > CLIENT_BUFFER_POOL_CAP) {
+		struct wlr_client_buffer_pool_texture *oldest =
+			wl_container_of(pool->textures.prev, oldest, link);
+		pool_texture_destroy(pool, oldest);
+	}
+}
+
 static void client_buffer_destroy(struct wlr_buffer *buffer) {
 	struct wlr_client_buffer *client_buffer = client_buffer_from_buffer(buffer);
 	wl_list_remove(&client_buffer->source_destroy.link);
 	wl_list_remove(&client_buffer->renderer_destroy.link);
+	if (client_buffer->pool != NULL) {
+		pool_recycle(client_buffer->pool, client_buffer);
+		pool_unref(client_buffer->pool);
+	}
 	wlr_texture_destroy(client_buffer->texture);
 	free(client_buffer);
 }
@@ -64,14 +176,8 @@ static void client_buffer_handle_renderer_destroy(struct wl_listener *listener,
 	client_buffer->texture = NULL;
 }
 
-struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
-		struct wlr_renderer *renderer) {
-	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, buffer);
-	if (texture == NULL) {
-		wlr_log(WLR_ERROR, "Failed to create texture");
-		return NULL;
-	}
-
+static struct wlr_client_buffer *client_buffer_create_with_texture(
+		struct wlr_buffer *buffer, struct wlr_texture *texture) {
 	struct wlr_client_buffer *client_buffer = calloc(1, sizeof(*client_buffer));
 	if (client_buffer == NULL) {
 		wlr_texture_destroy(texture);
@@ -81,6 +187,7 @@ struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 		texture->width, texture->height);
 	client_buffer->source = buffer;
 	client_buffer->texture = texture;
+	client_buffer->format = DRM_FORMAT_INVALID;
 
 	wl_signal_add(&buffer->events.destroy, &client_buffer->source_destroy);
 	client_buffer->source_destroy.notify = client_buffer_handle_source_destroy;
@@ -95,6 +202,17 @@ struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 	return client_buffer;
 }
 
+struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
+		struct wlr_renderer *renderer) {
+	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, buffer);
+	if (texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create texture");
+		return NULL;
+	}
+
+	return client_buffer_create_with_texture(buffer, texture);
+}
+
 bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 		struct wlr_buffer *next, const pixman_region32_t *damage) {
 	if (client_buffer->base.n_locks - client_buffer->n_ignore_locks > 1) {
@@ -107,3 +225,266 @@ bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 
 	return wlr_texture_update_from_buffer(client_buffer->texture, next, damage);
 }
+
+void client_buffer_history_init(struct wlr_client_buffer_history *history) {
+	static uint64_t last_id = 0;
+	*history = (struct wlr_client_buffer_history){
+		.id = ++last_id,
+	};
+	for (size_t i = 0; i < CLIENT_BUFFER_HISTORY_LEN; i++) {
+		pixman_region32_init(&history->damage[i]);
+	}
+}
+
+void client_buffer_history_finish(struct wlr_client_buffer_history *history) {
+	for (size_t i = 0; i < CLIENT_BUFFER_HISTORY_LEN; i++) {
+		pixman_region32_fini(&history->damage[i]);
+	}
+}
+
+static void history_push(struct wlr_client_buffer_history *history,
+		struct wlr_buffer *buffer, const pixman_region32_t *damage) {
+	// damage[i] holds the difference between contents seq - i - 1 and seq - i
+	pixman_region32_t oldest = history->damage[CLIENT_BUFFER_HISTORY_LEN - 1];
+	for (size_t i = CLIENT_BUFFER_HISTORY_LEN - 1; i > 0; i--) {
+		history->damage[i] = history->damage[i - 1];
+	}
+	history->damage[0] = oldest;
+
+	if (buffer->width != history->width || buffer->height != history->height) {
+		pixman_region32_fini(&history->damage[0]);
+		pixman_region32_init_rect(&history->damage[0], 0, 0,
+			buffer->width, buffer->height);
+	} else {
+		pixman_region32_intersect_rect(&history->damage[0], damage,
+			0, 0, buffer->width, buffer->height);
+	}
+
+	history->width = buffer->width;
+	history->height = buffer->height;
+	history->seq++;
+}
+
+// Get the damage accumulated since the contents with the provided sequence
+// number. Returns false if the history doesn't go back that far.
+static bool history_get_damage(struct wlr_client_buffer_history *history,
+		uint32_t seq, pixman_region32_t *damage) {
+	uint32_t age = history->seq - seq;
+	if (age > CLIENT_BUFFER_HISTORY_LEN) {
+		return false;
+	}
+	pixman_region32_clear(damage);
+	for (uint32_t i = 0; i < age; i++) {
+		pixman_region32_union(damage, damage, &history->damage[i]);
+	}
+	return true;
+}
+
+static uint64_t region_bytes(const pixman_region32_t *region, uint32_t format) {
+	const struct wlr_pixel_format_info *info = drm_get_pixel_format_info(format);
+	if (info == NULL) {
+		return 0;
+	}
+
+	uint64_t pixels = 0;
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		pixels += (uint64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+	}
+	return pixels * info->bytes_per_block / pixel_format_info_pixels_per_block(info);
+}
+
+static void account_upload(struct wlr_client_buffer_upload_stats *stats,
+		struct wlr_buffer *buffer, bool full, uint64_t bytes) {
+	if (full) {
+		stats->full_uploads++;
+	} else {
+		stats->partial_uploads++;
+	}
+	stats->uploaded_bytes += bytes;
+	shm_buffer_report_upload(buffer, bytes);
+}
+
+// Only textures holding a copy of the buffer contents can be updated and
+// recycled. Imported DMA-BUFs are zero-copy and lock the source buffer, this
+// includes shared memory buffers imported via udmabuf. Returns
+// DRM_FORMAT_INVALID if the buffer isn't copied.
+static uint32_t buffer_get_copy_format(struct wlr_buffer *buffer,
+		struct wlr_shm_attributes *shm) {
+	struct wlr_dmabuf_attributes dmabuf;
+	if (!wlr_buffer_get_shm(buffer, shm) ||
+			wlr_buffer_get_dmabuf(buffer, &dmabuf)) {
+		return DRM_FORMAT_INVALID;
+	}
+	return shm->format;
+}
+
+static void client_buffer_set_contents(struct wlr_client_buffer *client_buffer,
+		struct wlr_client_buffer_pool *pool,
+		struct wlr_client_buffer_history *history, uint32_t format) {
+	if (client_buffer->pool == NULL) {
+		client_buffer->pool = pool;
+		pool->n_refs++;
+	}
+	client_buffer->format = format;
+	client_buffer->history_id = history->id;
+	client_buffer->history_seq = history->seq;
+}
+
+static struct wlr_client_buffer *pool_try_update(
+		struct wlr_client_buffer_pool *pool,
+		struct wlr_client_buffer_history *history,
+		struct wlr_buffer *next, uint32_t format,
+		struct wlr_client_buffer_upload_stats *stats) {
+	struct wlr_client_buffer_pool_texture *match = NULL;
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+
+	// Prefer a texture holding recent contents of the same surface, so that
+	// only the regions which changed since then need to be uploaded
+	struct wlr_client_buffer_pool_texture *pool_tex;
+	wl_list_for_each(pool_tex, &pool->textures, link) {
+		if (pool_tex->format != format ||
+				pool_tex->texture->width != (uint32_t)next->width ||
+				pool_tex->texture->height != (uint32_t)next->height) {
+			continue;
+		}
+		if (pool_tex->history_id == history->id &&
+				history_get_damage(history, pool_tex->history_seq, &damage)) {
+			match = pool_tex;
+			break;
+		}
+		if (match == NULL) {
+			match = pool_tex;
+		}
+	}
+	if (match == NULL) {
+		pixman_region32_fini(&damage);
+		return NULL;
+	}
+
+	bool full = match->history_id != history->id ||
+		history->seq - match->history_seq > CLIENT_BUFFER_HISTORY_LEN;
+	if (full) {
+		pixman_region32_fini(&damage);
+		pixman_region32_init_rect(&damage, 0, 0, next->width, next->height);
+	}
+
+	struct wlr_texture *texture = match->texture;
+	match->texture = NULL;
+	pool_texture_destroy(pool, match);
+
+	if (!wlr_texture_update_from_buffer(texture, next, &damage)) {
+		wlr_texture_destroy(texture);
+		pixman_region32_fini(&damage);
+		return NULL;
+	}
+
+	account_upload(stats, next, full, region_bytes(&damage, format));
+	stats->recycled_textures++;
+	pixman_region32_fini(&damage);
+
+	return client_buffer_create_with_texture(next, texture);
+}
+
+struct wlr_client_buffer *client_buffer_update(
+		struct wlr_client_buffer_pool *pool,
+		struct wlr_client_buffer_history *history,
+		struct wlr_client_buffer *prev, struct wlr_buffer *next,
+		const pixman_region32_t *damage,
+		struct wlr_client_buffer_upload_stats *stats) {
+	history_push(history, next, damage);
+
+	struct wlr_shm_attributes shm;
+	uint32_t format = buffer_get_copy_format(next, &shm);
+
+	if (prev != NULL) {
+		// The previous contents may be older than the previous commit if an
+		// upload failed, in which case the history may not go back far enough
+		pixman_region32_t prev_damage;
+		pixman_region32_init(&prev_damage);
+		bool full = prev->history_id != history->id ||
+			!history_get_damage(history, prev->history_seq, &prev_damage);
+		if (full) {
+			pixman_region32_fini(&prev_damage);
+			pixman_region32_init_rect(&prev_damage, 0, 0,
+				next->width, next->height);
+		}
+
+		bool ok = wlr_client_buffer_apply_damage(prev, next, &prev_damage);
+		if (ok && format != DRM_FORMAT_INVALID) {
+			client_buffer_set_contents(prev, pool, history, format);
+			account_upload(stats, next, full,
+				region_bytes(&prev_damage, format));
+		}
+		pixman_region32_fini(&prev_damage);
+		if (ok) {
+			return prev;
+		}
+	}
+
+	struct wlr_client_buffer *client_buffer = NULL;
+	if (format != DRM_FORMAT_INVALID) {
+		client_buffer = pool_try_update(pool, history, next, format, stats);
+	}
+	if (client_buffer == NULL) {
+		client_buffer = wlr_client_buffer_create(next, pool->renderer);
+		if (client_buffer == NULL) {
+			return NULL;
+		}
+		if (format == DRM_FORMAT_INVALID) {
+			// The renderer may have failed to import the DMA-BUF and
+			// uploaded the buffer instead
+			format = buffer_get_copy_format(next, &shm);
+		}
+		if (!texture_holds_copy(client_buffer->texture)) {
+			format = DRM_FORMAT_INVALID;
+		}
+		if (format != DRM_FORMAT_INVALID) {
+			account_upload(stats, next, true, (uint64_t)shm.stride * shm.height);
+		}
+	}
+
+	if (format != DRM_FORMAT_INVALID) {
+		client_buffer_set_contents(client_buffer, pool, history, format);
+	}
+	return client_buffer;
+}
+
+struct wlr_client_buffer_pool *client_buffer_pool_create(
+		struct wlr_renderer *renderer, struct wl_event_loop *event_loop) {
+	struct wlr_client_buffer_pool *pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	pool->trim_timer = wl_event_loop_add_timer(event_loop,
+		pool_handle_trim_timer, pool);
+	if (pool->trim_timer == NULL) {
+		free(pool);
+		return NULL;
+	}
+	pool->renderer = renderer;
+	pool->n_refs = 1;
+	wl_list_init(&pool->textures);
+	return pool;
+}
+
+void client_buffer_pool_destroy(struct wlr_client_buffer_pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	struct wlr_client_buffer_pool_texture *pool_tex, *tmp;
+	wl_list_for_each_safe(pool_tex, tmp, &pool->textures, link) {
+		pool_texture_destroy(pool, pool_tex);
+	}
+	wl_event_source_remove(pool->trim_timer);
+	pool->trim_timer = NULL;
+
+	// Client buffers still referencing the pool will destroy their texture
+	// instead of recycling it
+	pool->renderer = NULL;
+	pool_unref(pool);
+}
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/swapchain.h>
 #include <wlr/render/wlr_renderer.h>
@@ -174,7 +175,100 @@ static bool output_pick_cursor_format(struct wlr_output *output,
 	return output_pick_format(output, display_formats, format, DRM_FORMAT_ARGB8888);
 }
 
-static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor) {
+// Whether the cursor buffer can be used as-is, without any transform or
+// scaling
+static bool output_cursor_source_is_simple(struct wlr_output_cursor *cursor,
+		struct wlr_buffer *source) {
+	if (source == NULL) {
+		return false;
+	}
+	const struct wlr_fbox *src_box = &cursor->src_box;
+	return cursor->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+		cursor->output->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+		cursor->width == (uint32_t)source->width &&
+		cursor->height == (uint32_t)source->height &&
+		src_box->x == 0 && src_box->y == 0 &&
+		src_box->width == source->width && src_box->height == source->height;
+}
+
+static bool output_cursor_source_is_scanout_compatible(struct wlr_output *output,
+		struct wlr_buffer *source) {
+	struct wlr_dmabuf_attributes dmabuf;
+	if (!wlr_buffer_get_dmabuf(source, &dmabuf) ||
+			dmabuf.format != DRM_FORMAT_ARGB8888) {
+		return false;
+	}
+	if (!output->impl->get_cursor_formats) {
+		return true;
+	}
+	const struct wlr_drm_format_set *formats =
+		output->impl->get_cursor_formats(output, WLR_BUFFER_CAP_DMABUF);
+	return formats != NULL &&
+		wlr_drm_format_set_has(formats, dmabuf.format, dmabuf.modifier);
+}
+
+bool output_cursor_source_is_usable(struct wlr_output *output,
+		struct wlr_buffer *source) {
+	if (!output->impl->set_cursor || output->software_cursor_locks > 0) {
+		return false;
+	}
+
+	struct wlr_dmabuf_attributes dmabuf;
+	struct wlr_shm_attributes shm;
+	if (wlr_buffer_get_dmabuf(source, &dmabuf)) {
+		return dmabuf.format == DRM_FORMAT_ARGB8888;
+	} else if (wlr_buffer_get_shm(source, &shm)) {
+		return shm.format == DRM_FORMAT_ARGB8888;
+	}
+	return false;
+}
+
+// Copy an ARGB8888 cursor image into the top-left corner of a larger buffer
+// with the CPU, clearing the rest
+static bool copy_cursor_buffer(struct wlr_buffer *dst, struct wlr_buffer *src) {
+	void *src_data;
+	uint32_t src_format;
+	size_t src_stride;
+	if (!wlr_buffer_begin_data_ptr_access(src, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+			&src_data, &src_format, &src_stride)) {
+		return false;
+	}
+
+	void *dst_data;
+	uint32_t dst_format;
+	size_t dst_stride;
+	if (!wlr_buffer_begin_data_ptr_access(dst, WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
+			&dst_data, &dst_format, &dst_stride)) {
+		wlr_buffer_end_data_ptr_access(src);
+		return false;
+	}
+
+	bool ok = src_format == DRM_FORMAT_ARGB8888 &&
+		dst_format == DRM_FORMAT_ARGB8888 &&
+		src->width <= dst->width && src->height <= dst->height;
+	if (ok) {
+		size_t src_row_size = (size_t)src->width * 4;
+		size_t dst_row_size = (size_t)dst->width * 4;
+		for (int y = 0; y < dst->height; y++) {
+			char *dst_row = (char *)dst_data + y * dst_stride;
+			size_t copied = 0;
+			if (y < src->height) {
+				memcpy(dst_row, (char *)src_data + y * src_stride, src_row_size);
+				copied = src_row_size;
+			}
+			memset(dst_row + copied, 0, dst_row_size - copied);
+		}
+	}
+
+	wlr_buffer_end_data_ptr_access(dst);
+	wlr_buffer_end_data_ptr_access(src);
+	return ok;
+}
+
+// If allow_direct is true, the source buffer may be returned as-is, in which
+// case direct is set to true
+static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor,
+		struct wlr_buffer *source, bool allow_direct, bool *direct) {
 	struct wlr_output *output = cursor->output;
 
 	struct wlr_texture *texture = cursor->texture;
@@ -199,6 +293,16 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 		}
 	}
 
+	*direct = false;
+	bool simple = output_cursor_source_is_simple(cursor, source);
+	if (allow_direct && simple && source->width == width &&
+			source->height == height &&
+			output_cursor_source_is_scanout_compatible(output, source)) {
+		// The backend may be able to use the buffer directly
+		*direct = true;
+		return wlr_buffer_lock(source);
+	}
+
 	if (output->cursor_swapchain == NULL ||
 			output->cursor_swapchain->width != width ||
 			output->cursor_swapchain->height != height) {
@@ -224,6 +328,12 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 		return NULL;
 	}
 
+	// Padding the image to the hardware cursor size doesn't need a render
+	// pass if both buffers are CPU-accessible
+	if (simple && copy_cursor_buffer(buffer, source)) {
+		return buffer;
+	}
+
 	struct wlr_box dst_box = {
 		.width = cursor->width,
 		.height = cursor->height,
@@ -259,7 +369,8 @@ static struct wlr_buffer *render_cursor_buffer(struct wlr_output_cursor *cursor)
 	return buffer;
 }
 
-static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor) {
+static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor,
+		struct wlr_buffer *source) {
 	struct wlr_output *output = cursor->output;
 
 	if (!output->impl->set_cursor ||
@@ -279,25 +390,39 @@ static bool output_cursor_attempt_hardware(struct wlr_output_cursor *cursor) {
 	output->impl->move_cursor(cursor->output,
 		(int)cursor->x, (int)cursor->y);
 
-	struct wlr_buffer *buffer = NULL;
-	if (texture != NULL) {
-		buffer = render_cursor_buffer(cursor);
-		if (buffer == NULL) {
-			wlr_log(WLR_DEBUG, "Failed to render cursor buffer");
-			return false;
+	bool allow_direct = true;
+	bool ok;
+	while (true) {
+		struct wlr_buffer *buffer = NULL;
+		bool direct = false;
+		if (texture != NULL) {
+			buffer = render_cursor_buffer(cursor, source, allow_direct, &direct);
+			if (buffer == NULL) {
+				wlr_log(WLR_DEBUG, "Failed to render cursor buffer");
+				return false;
+			}
 		}
-	}
 
-	struct wlr_box hotspot = {
-		.x = cursor->hotspot_x,
-		.y = cursor->hotspot_y,
-	};
-	wlr_box_transform(&hotspot, &hotspot,
-		wlr_output_transform_invert(output->transform),
-		buffer ? buffer->width : 0, buffer ? buffer->height : 0);
+		struct wlr_box hotspot = {
+			.x = cursor->hotspot_x,
+			.y = cursor->hotspot_y,
+		};
+		wlr_box_transform(&hotspot, &hotspot,
+			wlr_output_transform_invert(output->transform),
+			buffer ? buffer->width : 0, buffer ? buffer->height : 0);
 
-	bool ok = output_set_hardware_cursor(output, buffer, hotspot.x, hotspot.y);
-	wlr_buffer_unlock(buffer);
+		ok = output_set_hardware_cursor(output, buffer, hotspot.x, hotspot.y);
+		wlr_buffer_unlock(buffer);
+		if (ok || !direct) {
+			break;
+		}
+
+		// Matching formats and modifiers don't guarantee that the backend can
+		// import the source buffer, e.g. it may have been allocated on another
+		// device: retry with a buffer from the output's allocator
+		wlr_log(WLR_DEBUG, "Backend rejected cursor buffer, copying it");
+		allow_direct = false;
+	}
 	if (ok) {
 		output->hardware_cursor = cursor;
 	}
@@ -330,19 +455,20 @@ bool wlr_output_cursor_set_buffer(struct wlr_output_cursor *cursor,
 	hotspot_x /= cursor->output->scale;
 	hotspot_y /= cursor->output->scale;
 
-	return output_cursor_set_texture(cursor, texture, true, &src_box,
+	return output_cursor_set_texture(cursor, texture, true, buffer, &src_box,
 		dst_width, dst_height, WL_OUTPUT_TRANSFORM_NORMAL, hotspot_x, hotspot_y);
 }
 
 static void output_cursor_handle_renderer_destroy(struct wl_listener *listener,
 		void *data) {
 	struct wlr_output_cursor *cursor = wl_container_of(listener, cursor, renderer_destroy);
-	output_cursor_set_texture(cursor, NULL, false, NULL, 0, 0,
+	output_cursor_set_texture(cursor, NULL, false, NULL, NULL, 0, 0,
 		WL_OUTPUT_TRANSFORM_NORMAL, 0, 0);
 }
 
 bool output_cursor_set_texture(struct wlr_output_cursor *cursor,
-		struct wlr_texture *texture, bool own_texture, const struct wlr_fbox *src_box,
+		struct wlr_texture *texture, bool own_texture, struct wlr_buffer *source,
+		const struct wlr_fbox *src_box,
 		int dst_width, int dst_height, enum wl_output_transform transform,
 		int32_t hotspot_x, int32_t hotspot_y) {
 	struct wlr_output *output = cursor->output;
@@ -379,7 +505,7 @@ bool output_cursor_set_texture(struct wlr_output_cursor *cursor,
 		wl_list_init(&cursor->renderer_destroy.link);
 	}
 
-	if (output_cursor_attempt_hardware(cursor)) {
+	if (output_cursor_attempt_hardware(cursor, source)) {
 		return true;
 	}
 
@@ -77,6 +77,43 @@ static void send_done(struct wl_resource *resource) {
 	}
 }
 
+static void output_save_sent_state(struct wlr_output *output) {
+	output->sent_state.width = output->width;
+	output->sent_state.height = output->height;
+	output->sent_state.refresh = output->refresh;
+	output->sent_state.subpixel = output->subpixel;
+	output->sent_state.transform = output->transform;
+	output->sent_state.scale = (int32_t)ceil(output->scale);
+}
+
+// Only send the properties which changed since the last done event
+static void output_send_state_updates(struct wlr_output *output) {
+	bool mode_updated = output->sent_state.width != output->width ||
+		output->sent_state.height != output->height ||
+		output->sent_state.refresh != output->refresh;
+	bool geometry_updated = output->sent_state.subpixel != output->subpixel ||
+		output->sent_state.transform != output->transform;
+	bool scale_updated =
+		output->sent_state.scale != (int32_t)ceil(output->scale);
+
+	if (mode_updated || geometry_updated || scale_updated) {
+		struct wl_resource *resource;
+		wl_resource_for_each(resource, &output->resources) {
+			if (mode_updated) {
+				send_current_mode(resource);
+			}
+			if (geometry_updated) {
+				send_geometry(resource);
+			}
+			if (scale_updated) {
+				send_scale(resource);
+			}
+		}
+	}
+
+	output_save_sent_state(output);
+}
+
 static void output_handle_resource_destroy(struct wl_resource *resource) {
 	wl_list_remove(wl_resource_get_link(resource));
 }
@@ -145,6 +182,8 @@ void wlr_output_create_global(struct wlr_output *output, struct wl_display *disp
 
 	wl_list_remove(&output->display_destroy.link);
 	wl_display_add_destroy_listener(display, &output->display_destroy);
+
+	output_save_sent_state(output);
 }
 
 void wlr_output_destroy_global(struct wlr_output *output) {
@@ -171,6 +210,8 @@ static void schedule_done_handle_idle_timer(void *data) {
 	struct wlr_output *output = data;
 	output->idle_done = NULL;
 
+	output_send_state_updates(output);
+
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &output->resources) {
 		send_done(resource);
@@ -316,18 +357,8 @@ static void output_apply_state(struct wlr_output *output,
 	}
 
 	if (geometry_updated || scale_updated || mode_updated) {
-		struct wl_resource *resource;
-		wl_resource_for_each(resource, &output->resources) {
-			if (mode_updated) {
-				send_current_mode(resource);
-			}
-			if (geometry_updated) {
-				send_geometry(resource);
-			}
-			if (scale_updated) {
-				send_scale(resource);
-			}
-		}
+		// Changes are sent to clients along with the next done event, so
+		// that multiple commits in a row only produce a single update
 		wlr_output_schedule_done(output);
 	}
 }
@@ -418,6 +449,10 @@ void wlr_output_destroy(struct wlr_output *output) {
 		wl_event_source_remove(output->idle_done);
 	}
 
+	if (output->swapchain_trim_timer != NULL) {
+		wl_event_source_remove(output->swapchain_trim_timer);
+	}
+
 	free(output->name);
 	free(output->description);
 	free(output->make);
@@ -688,9 +723,39 @@ bool output_prepare_commit(struct wlr_output *output, const struct wlr_output_st
 	return true;
 }
 
+static int handle_swapchain_trim_timer(void *data) {
+	struct wlr_output *output = data;
+	if (output->swapchain != NULL) {
+		wlr_swapchain_trim(output->swapchain);
+	}
+	if (output->cursor_swapchain != NULL) {
+		wlr_swapchain_trim(output->cursor_swapchain);
+	}
+	return 0;
+}
+
+// Swapchains only release idle buffers when acquiring a new one. Trim them once
+// the output stops committing new buffers, e.g. because its content is static.
+static void output_schedule_swapchain_trim(struct wlr_output *output) {
+	if (output->swapchain_trim_timer == NULL) {
+		output->swapchain_trim_timer = wl_event_loop_add_timer(
+			output->event_loop, handle_swapchain_trim_timer, output);
+		if (output->swapchain_trim_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create swapchain trim timer");
+			return;
+		}
+	}
+	wl_event_source_timer_update(output->swapchain_trim_timer,
+		WLR_SWAPCHAIN_IDLE_TIMEOUT_MSEC);
+}
+
 void output_apply_commit(struct wlr_output *output, const struct wlr_output_state *state) {
 	output->commit_seq++;
 
+	if (state->committed & WLR_OUTPUT_STATE_BUFFER) {
+		output_schedule_swapchain_trim(output);
+	}
+
 	if (output_pending_enabled(output, state)) {
 		output->frame_pending = true;
 		output->needs_frame = false;
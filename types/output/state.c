@@ -18,6 +18,16 @@ void wlr_output_state_finish(struct wlr_output_state *state) {
 	free(state->gamma_lut);
 }
 
+void output_state_reset(struct wlr_output_state *state) {
+	wlr_buffer_unlock(state->buffer);
+	free(state->gamma_lut);
+
+	// pixman_region32_copy() reuses the destination rectangles if there
+	// are enough of them, so keep the region around
+	pixman_region32_t damage = state->damage;
+	*state = (struct wlr_output_state){ .damage = damage };
+}
+
 void wlr_output_state_set_enabled(struct wlr_output_state *state,
 		bool enabled) {
 	state->committed |= WLR_OUTPUT_STATE_ENABLED;
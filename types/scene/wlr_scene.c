@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/backend.h>
+#include <wlr/render/recorder.h>
 #include <wlr/render/swapchain.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_compositor.h>
@@ -86,6 +87,29 @@ static void scene_buffer_set_buffer(struct wlr_scene_buffer *scene_buffer,
 static void scene_buffer_set_texture(struct wlr_scene_buffer *scene_buffer,
 	struct wlr_texture *texture);
 
+#define OUTPUT_SET_WORD_BITS 64
+// Output sets of up to this many words don't need a heap allocation while
+// being computed
+#define OUTPUT_SET_STACK_WORDS 4
+#define OUTPUT_ARRAY_STACK_SIZE 64
+
+static size_t output_set_words(struct wl_list *outputs) {
+	if (wl_list_empty(outputs)) {
+		return 0;
+	}
+	// Outputs are sorted by index
+	struct wlr_scene_output *last = wl_container_of(outputs->prev, last, link);
+	return last->index / OUTPUT_SET_WORD_BITS + 1;
+}
+
+static bool output_set_test(const uint64_t *set, size_t len, size_t index) {
+	size_t word = index / OUTPUT_SET_WORD_BITS;
+	if (word >= len) {
+		return false;
+	}
+	return set[word] & (1ull << (index % OUTPUT_SET_WORD_BITS));
+}
+
 void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 	if (node == NULL) {
 		return;
@@ -103,16 +127,18 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 	if (node->type == WLR_SCENE_NODE_BUFFER) {
 		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
 
-		uint64_t active = scene_buffer->active_outputs;
-		if (active) {
+		if (scene_buffer->active_outputs_len > 0) {
 			struct wlr_scene_output *scene_output;
 			wl_list_for_each(scene_output, &scene->outputs, link) {
-				if (active & (1ull << scene_output->index)) {
+				if (output_set_test(scene_buffer->active_outputs,
+						scene_buffer->active_outputs_len, scene_output->index)) {
 					wl_signal_emit_mutable(&scene_buffer->events.output_leave,
 						scene_output);
 				}
 			}
 		}
+		free(scene_buffer->active_outputs);
+		wl_list_remove(&scene_buffer->primary_output_link);
 
 		scene_buffer_set_buffer(scene_buffer, NULL);
 		scene_buffer_set_texture(scene_buffer, NULL);
@@ -128,6 +154,8 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 			}
 
 			wl_list_remove(&scene->linux_dmabuf_v1_destroy.link);
+			pixman_region32_fini(&scene->transaction_update);
+			pixman_region32_fini(&scene->transaction_damage);
 		} else {
 			assert(node->parent);
 		}
@@ -161,6 +189,8 @@ struct wlr_scene *wlr_scene_create(void) {
 
 	wl_list_init(&scene->outputs);
 	wl_list_init(&scene->linux_dmabuf_v1_destroy.link);
+	pixman_region32_init(&scene->transaction_update);
+	pixman_region32_init(&scene->transaction_damage);
 
 	const char *debug_damage_options[] = {
 		"none",
@@ -270,6 +300,8 @@ struct scene_update_data {
 	pixman_region32_t *update_region;
 	struct wl_list *outputs;
 	bool calculate_visibility;
+	// If non-NULL, accumulates the regions where node visibility changed
+	pixman_region32_t *changed;
 };
 
 static uint32_t region_area(pixman_region32_t *region) {
@@ -334,6 +366,47 @@ static void scene_damage_outputs(struct wlr_scene *scene, pixman_region32_t *dam
 	}
 }
 
+static bool output_set_equal(const uint64_t *a, size_t a_len,
+		const uint64_t *b, size_t b_len) {
+	size_t len = a_len > b_len ? a_len : b_len;
+	for (size_t i = 0; i < len; i++) {
+		uint64_t a_word = i < a_len ? a[i] : 0;
+		uint64_t b_word = i < b_len ? b[i] : 0;
+		if (a_word != b_word) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool scene_buffer_set_active_outputs(struct wlr_scene_buffer *scene_buffer,
+		const uint64_t *set, size_t len) {
+	// Trailing empty words aren't stored
+	while (len > 0 && set[len - 1] == 0) {
+		len--;
+	}
+
+	if (len == 0) {
+		free(scene_buffer->active_outputs);
+		scene_buffer->active_outputs = NULL;
+		scene_buffer->active_outputs_len = 0;
+		return true;
+	}
+
+	if (len != scene_buffer->active_outputs_len) {
+		uint64_t *active = realloc(scene_buffer->active_outputs,
+			len * sizeof(*active));
+		if (active == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			return false;
+		}
+		scene_buffer->active_outputs = active;
+		scene_buffer->active_outputs_len = len;
+	}
+	memcpy(scene_buffer->active_outputs, set, len * sizeof(*set));
+	return true;
+}
+
 static void update_node_update_outputs(struct wlr_scene_node *node,
 		struct wl_list *outputs, struct wlr_scene_output *ignore,
 		struct wlr_scene_output *force) {
@@ -343,12 +416,22 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 
 	struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
 
+	size_t active_len = output_set_words(outputs);
+	uint64_t active_stack[OUTPUT_SET_STACK_WORDS] = {0};
+	uint64_t *active_outputs = active_stack;
+	if (active_len > OUTPUT_SET_STACK_WORDS) {
+		active_outputs = calloc(active_len, sizeof(*active_outputs));
+		if (active_outputs == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			return;
+		}
+	}
+
 	uint32_t largest_overlap = 0;
 	struct wlr_scene_output *old_primary_output = scene_buffer->primary_output;
 	scene_buffer->primary_output = NULL;
 
 	size_t count = 0;
-	uint64_t active_outputs = 0;
 
 	// let's update the outputs in two steps:
 	//  - the primary outputs
@@ -385,7 +468,8 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 				scene_buffer->primary_output = scene_output;
 			}
 
-			active_outputs |= 1ull << scene_output->index;
+			active_outputs[scene_output->index / OUTPUT_SET_WORD_BITS] |=
+				1ull << (scene_output->index % OUTPUT_SET_WORD_BITS);
 			count++;
 		}
 
@@ -397,33 +481,71 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 			(struct wlr_linux_dmabuf_feedback_v1_init_options){0};
 	}
 
-	uint64_t old_active = scene_buffer->active_outputs;
-	scene_buffer->active_outputs = active_outputs;
+	// Disabled buffers are unlinked without touching their primary output
+	if (old_primary_output != scene_buffer->primary_output ||
+			wl_list_empty(&scene_buffer->primary_output_link)) {
+		wl_list_remove(&scene_buffer->primary_output_link);
+		if (scene_buffer->primary_output != NULL) {
+			wl_list_insert(&scene_buffer->primary_output->primary_buffers,
+				&scene_buffer->primary_output_link);
+		} else {
+			wl_list_init(&scene_buffer->primary_output_link);
+		}
+	}
 
-	wl_list_for_each(scene_output, outputs, link) {
-		uint64_t mask = 1ull << scene_output->index;
-		bool intersects = active_outputs & mask;
-		bool intersects_before = old_active & mask;
-
-		if (intersects && !intersects_before) {
-			wl_signal_emit_mutable(&scene_buffer->events.output_enter, scene_output);
-		} else if (!intersects && intersects_before) {
-			wl_signal_emit_mutable(&scene_buffer->events.output_leave, scene_output);
+	uint64_t *old_active = scene_buffer->active_outputs;
+	size_t old_active_len = scene_buffer->active_outputs_len;
+	bool active_changed = !output_set_equal(old_active, old_active_len,
+		active_outputs, active_len);
+	if (active_changed) {
+		// Swap in the new set, keeping the old one around for the
+		// enter/leave events
+		scene_buffer->active_outputs = NULL;
+		scene_buffer->active_outputs_len = 0;
+		if (!scene_buffer_set_active_outputs(scene_buffer,
+				active_outputs, active_len)) {
+			scene_buffer->active_outputs = old_active;
+			scene_buffer->active_outputs_len = old_active_len;
+			goto out;
+		}
+	}
+
+	if (active_changed) {
+		wl_list_for_each(scene_output, outputs, link) {
+			bool intersects = output_set_test(active_outputs, active_len,
+				scene_output->index);
+			bool intersects_before = output_set_test(old_active,
+				old_active_len, scene_output->index);
+
+			if (intersects && !intersects_before) {
+				wl_signal_emit_mutable(&scene_buffer->events.output_enter, scene_output);
+			} else if (!intersects && intersects_before) {
+				wl_signal_emit_mutable(&scene_buffer->events.output_leave, scene_output);
+			}
 		}
 	}
 
 	// if there are active outputs on this node, we should always have a primary
 	// output
-	assert(!scene_buffer->active_outputs || scene_buffer->primary_output);
+	assert(!count || scene_buffer->primary_output);
 
 	// Skip output update event if nothing was updated
-	if (old_active == active_outputs &&
-			(!force || ((1ull << force->index) & ~active_outputs)) &&
+	if (!active_changed &&
+			(!force || !output_set_test(active_outputs, active_len, force->index)) &&
 			old_primary_output == scene_buffer->primary_output) {
-		return;
+		goto out_old;
+	}
+
+	struct wlr_scene_output *outputs_stack[OUTPUT_ARRAY_STACK_SIZE];
+	struct wlr_scene_output **outputs_array = outputs_stack;
+	if (count > OUTPUT_ARRAY_STACK_SIZE) {
+		outputs_array = calloc(count, sizeof(*outputs_array));
+		if (outputs_array == NULL) {
+			wlr_log_errno(WLR_ERROR, "Allocation failed");
+			goto out_old;
+		}
 	}
 
-	struct wlr_scene_output *outputs_array[64];
 	struct wlr_scene_outputs_update_event event = {
 		.active = outputs_array,
 		.size = count,
@@ -431,7 +553,7 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 
 	size_t i = 0;
 	wl_list_for_each(scene_output, outputs, link) {
-		if (~active_outputs & (1ull << scene_output->index)) {
+		if (!output_set_test(active_outputs, active_len, scene_output->index)) {
 			continue;
 		}
 
@@ -440,6 +562,18 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 	}
 
 	wl_signal_emit_mutable(&scene_buffer->events.outputs_update, &event);
+
+	if (outputs_array != outputs_stack) {
+		free(outputs_array);
+	}
+out_old:
+	if (active_changed) {
+		free(old_active);
+	}
+out:
+	if (active_outputs != active_stack) {
+		free(active_outputs);
+	}
 }
 
 static bool scene_node_update_iterator(struct wlr_scene_node *node,
@@ -449,11 +583,28 @@ static bool scene_node_update_iterator(struct wlr_scene_node *node,
 	struct wlr_box box = { .x = lx, .y = ly };
 	scene_node_get_size(node, &box.width, &box.height);
 
+	pixman_region32_t old_visible;
+	pixman_region32_init(&old_visible);
+	if (data->changed) {
+		pixman_region32_copy(&old_visible, &node->visible);
+	}
+
 	pixman_region32_subtract(&node->visible, &node->visible, data->update_region);
 	pixman_region32_union(&node->visible, &node->visible, data->visible);
 	pixman_region32_intersect_rect(&node->visible, &node->visible,
 		lx, ly, box.width, box.height);
 
+	if (data->changed) {
+		pixman_region32_t diff;
+		pixman_region32_init(&diff);
+		pixman_region32_subtract(&diff, &old_visible, &node->visible);
+		pixman_region32_union(data->changed, data->changed, &diff);
+		pixman_region32_subtract(&diff, &node->visible, &old_visible);
+		pixman_region32_union(data->changed, data->changed, &diff);
+		pixman_region32_fini(&diff);
+	}
+	pixman_region32_fini(&old_visible);
+
 	if (data->calculate_visibility) {
 		pixman_region32_t opaque;
 		pixman_region32_init(&opaque);
@@ -505,8 +656,8 @@ static void scene_node_bounds(struct wlr_scene_node *node,
 	pixman_region32_union_rect(visible, visible, x, y, width, height);
 }
 
-static void scene_update_region(struct wlr_scene *scene,
-		pixman_region32_t *update_region) {
+static void scene_update_region_full(struct wlr_scene *scene,
+		pixman_region32_t *update_region, pixman_region32_t *changed) {
 	pixman_region32_t visible;
 	pixman_region32_init(&visible);
 	pixman_region32_copy(&visible, update_region);
@@ -516,6 +667,7 @@ static void scene_update_region(struct wlr_scene *scene,
 		.update_region = update_region,
 		.outputs = &scene->outputs,
 		.calculate_visibility = scene->calculate_visibility,
+		.changed = changed,
 	};
 
 	struct pixman_box32 *region_box = pixman_region32_extents(update_region);
@@ -532,13 +684,92 @@ static void scene_update_region(struct wlr_scene *scene,
 	pixman_region32_fini(&visible);
 }
 
+static void scene_update_region(struct wlr_scene *scene,
+		pixman_region32_t *update_region) {
+	if (scene->transaction_depth > 0) {
+		pixman_region32_union(&scene->transaction_update,
+			&scene->transaction_update, update_region);
+		return;
+	}
+
+	scene_update_region_full(scene, update_region, NULL);
+}
+
+static void scene_transaction_flush(struct wlr_scene *scene) {
+	if (!pixman_region32_not_empty(&scene->transaction_update) &&
+			!pixman_region32_not_empty(&scene->transaction_damage)) {
+		return;
+	}
+
+	// Take the pending regions first: signal handlers invoked while updating
+	// outputs may modify the scene again
+	pixman_region32_t update_region, damage;
+	pixman_region32_init(&update_region);
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&update_region, &scene->transaction_update);
+	pixman_region32_copy(&damage, &scene->transaction_damage);
+	pixman_region32_clear(&scene->transaction_update);
+	pixman_region32_clear(&scene->transaction_damage);
+
+	// The old visible regions of updated nodes are already part of the
+	// damage, add the regions where nodes became visible
+	if (pixman_region32_not_empty(&update_region)) {
+		scene_update_region_full(scene, &update_region, &damage);
+	}
+	scene_damage_outputs(scene, &damage);
+
+	pixman_region32_fini(&update_region);
+	pixman_region32_fini(&damage);
+}
+
+void wlr_scene_transaction_begin(struct wlr_scene *scene) {
+	scene->transaction_depth++;
+}
+
+void wlr_scene_transaction_commit(struct wlr_scene *scene) {
+	assert(scene->transaction_depth > 0);
+	scene->transaction_depth--;
+	if (scene->transaction_depth == 0) {
+		scene_transaction_flush(scene);
+	}
+}
+
+// Disabled nodes aren't visited when visibility is updated, so their visible
+// region would go stale. Clear it when a node gets hidden (disabled itself or
+// moved under a disabled tree): once re-enabled, the whole region where the
+// nodes are visible then shows up as changed when a transaction is flushed.
+static void scene_node_clear_visible(struct wlr_scene_node *node) {
+	pixman_region32_clear(&node->visible);
+
+	if (node->type == WLR_SCENE_NODE_BUFFER) {
+		// Hidden buffers don't get frame events from their primary output
+		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
+		wl_list_remove(&scene_buffer->primary_output_link);
+		wl_list_init(&scene_buffer->primary_output_link);
+	} else if (node->type == WLR_SCENE_NODE_TREE) {
+		struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
+		struct wlr_scene_node *child;
+		wl_list_for_each(child, &scene_tree->children, link) {
+			scene_node_clear_visible(child);
+		}
+	}
+}
+
 static void scene_node_update(struct wlr_scene_node *node,
 		pixman_region32_t *damage) {
 	struct wlr_scene *scene = scene_node_get_root(node);
 
 	int x, y;
 	if (!wlr_scene_node_coords(node, &x, &y)) {
-		if (damage) {
+		scene_node_clear_visible(node);
+
+		if (damage && scene->transaction_depth > 0) {
+			pixman_region32_union(&scene->transaction_update,
+				&scene->transaction_update, damage);
+			pixman_region32_union(&scene->transaction_damage,
+				&scene->transaction_damage, damage);
+			pixman_region32_fini(damage);
+		} else if (damage) {
 			scene_update_region(scene, damage);
 			scene_damage_outputs(scene, damage);
 			pixman_region32_fini(damage);
@@ -559,6 +790,17 @@ static void scene_node_update(struct wlr_scene_node *node,
 	pixman_region32_copy(&update_region, damage);
 	scene_node_bounds(node, x, y, &update_region);
 
+	if (scene->transaction_depth > 0) {
+		// Visibility is computed once when the transaction is flushed
+		pixman_region32_union(&scene->transaction_update,
+			&scene->transaction_update, &update_region);
+		pixman_region32_union(&scene->transaction_damage,
+			&scene->transaction_damage, damage);
+		pixman_region32_fini(&update_region);
+		pixman_region32_fini(damage);
+		return;
+	}
+
 	scene_update_region(scene, &update_region);
 	pixman_region32_fini(&update_region);
 
@@ -671,6 +913,7 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 	wl_signal_init(&scene_buffer->events.output_leave);
 	wl_signal_init(&scene_buffer->events.output_sample);
 	wl_signal_init(&scene_buffer->events.frame_done);
+	wl_list_init(&scene_buffer->primary_output_link);
 	pixman_region32_init(&scene_buffer->opaque_region);
 	wl_list_init(&scene_buffer->buffer_release.link);
 	wl_list_init(&scene_buffer->renderer_destroy.link);
@@ -967,7 +1210,6 @@ void wlr_scene_node_set_enabled(struct wlr_scene_node *node, bool enabled) {
 	}
 
 	node->enabled = enabled;
-
 	scene_node_update(node, &visible);
 }
 
@@ -1369,23 +1611,24 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 
 	wlr_damage_ring_init(&scene_output->damage_ring);
 	pixman_region32_init(&scene_output->pending_commit_damage);
+	wlr_output_state_init(&scene_output->commit_state);
 	wl_list_init(&scene_output->damage_highlight_regions);
+	wl_list_init(&scene_output->primary_buffers);
 
-	int prev_output_index = -1;
+	size_t next_output_index = 0;
 	struct wl_list *prev_output_link = &scene->outputs;
 
 	struct wlr_scene_output *current_output;
 	wl_list_for_each(current_output, &scene->outputs, link) {
-		if (prev_output_index + 1 != current_output->index) {
+		if (next_output_index != current_output->index) {
 			break;
 		}
 
-		prev_output_index = current_output->index;
+		next_output_index = current_output->index + 1;
 		prev_output_link = &current_output->link;
 	}
 
-	scene_output->index = prev_output_index + 1;
-	assert(scene_output->index < 64);
+	scene_output->index = next_output_index;
 	wl_list_insert(prev_output_link, &scene_output->link);
 
 	wl_signal_init(&scene_output->events.destroy);
@@ -1420,6 +1663,15 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 	scene_node_output_update(&scene_output->scene->tree.node,
 		&scene_output->scene->outputs, scene_output, NULL);
 
+	// Only left non-empty if updating the outputs above failed
+	struct wlr_scene_buffer *scene_buffer, *tmp_buffer;
+	wl_list_for_each_safe(scene_buffer, tmp_buffer,
+			&scene_output->primary_buffers, primary_output_link) {
+		scene_buffer->primary_output = NULL;
+		wl_list_remove(&scene_buffer->primary_output_link);
+		wl_list_init(&scene_buffer->primary_output_link);
+	}
+
 	struct highlight_region *damage, *tmp_damage;
 	wl_list_for_each_safe(damage, tmp_damage, &scene_output->damage_highlight_regions, link) {
 		highlight_region_destroy(damage);
@@ -1428,6 +1680,7 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 	wlr_addon_finish(&scene_output->addon);
 	wlr_damage_ring_finish(&scene_output->damage_ring);
 	pixman_region32_fini(&scene_output->pending_commit_damage);
+	wlr_output_state_finish(&scene_output->commit_state);
 	wl_list_remove(&scene_output->link);
 	wl_list_remove(&scene_output->output_commit.link);
 	wl_list_remove(&scene_output->output_damage.link);
@@ -1645,21 +1898,17 @@ static bool scene_entry_try_direct_scanout(struct render_list_entry *entry,
 		entry->sent_dmabuf_feedback = true;
 	}
 
-	struct wlr_output_state pending;
-	wlr_output_state_init(&pending);
-	if (!wlr_output_state_copy(&pending, state)) {
-		return false;
-	}
-
-	wlr_output_state_set_buffer(&pending, buffer->buffer);
+	// Create a shallow copy of the state, wlr_output_test_state() doesn't
+	// take ownership of it
+	struct wlr_output_state pending = *state;
+	pending.committed |= WLR_OUTPUT_STATE_BUFFER;
+	pending.buffer = buffer->buffer;
 
 	if (!wlr_output_test_state(scene_output->output, &pending)) {
-		wlr_output_state_finish(&pending);
 		return false;
 	}
 
-	wlr_output_state_copy(state, &pending);
-	wlr_output_state_finish(&pending);
+	wlr_output_state_set_buffer(state, buffer->buffer);
 
 	struct wlr_scene_output_sample_event sample_event = {
 		.output = scene_output,
@@ -1677,19 +1926,18 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output,
 	}
 
 	bool ok = false;
-	struct wlr_output_state state;
-	wlr_output_state_init(&state);
-	if (!wlr_scene_output_build_state(scene_output, &state, options)) {
+	struct wlr_output_state *state = &scene_output->commit_state;
+	if (!wlr_scene_output_build_state(scene_output, state, options)) {
 		goto out;
 	}
 
-	ok = wlr_output_commit_state(scene_output->output, &state);
+	ok = wlr_output_commit_state(scene_output->output, state);
 	if (!ok) {
 		goto out;
 	}
 
 out:
-	wlr_output_state_finish(&state);
+	output_state_reset(state);
 	return ok;
 }
 
@@ -1712,6 +1960,9 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 		return true;
 	}
 
+	// Apply changes made by a transaction which hasn't been committed yet
+	scene_transaction_flush(scene_output->scene);
+
 	struct wlr_output *output = scene_output->output;
 	enum wlr_scene_debug_damage_option debug_damage =
 		scene_output->scene->debug_damage_option;
@@ -1865,6 +2116,14 @@ bool wlr_scene_output_build_state(struct wlr_scene_output *scene_output,
 		return false;
 	}
 
+	if (options->recorder != NULL) {
+		struct wlr_render_pass *recording_pass = wlr_render_recorder_wrap_pass(
+			options->recorder, render_pass, buffer->width, buffer->height);
+		if (recording_pass != NULL) {
+			render_pass = recording_pass;
+		}
+	}
+
 	render_data.render_pass = render_pass;
 
 	pixman_region32_init(&render_data.damage);
@@ -1988,32 +2247,13 @@ void wlr_scene_timer_finish(struct wlr_scene_timer *timer) {
 	}
 }
 
-static void scene_node_send_frame_done(struct wlr_scene_node *node,
-		struct wlr_scene_output *scene_output, struct timespec *now) {
-	if (!node->enabled) {
-		return;
-	}
-
-	if (node->type == WLR_SCENE_NODE_BUFFER) {
-		struct wlr_scene_buffer *scene_buffer =
-			wlr_scene_buffer_from_node(node);
-
-		if (scene_buffer->primary_output == scene_output) {
-			wlr_scene_buffer_send_frame_done(scene_buffer, now);
-		}
-	} else if (node->type == WLR_SCENE_NODE_TREE) {
-		struct wlr_scene_tree *scene_tree = wlr_scene_tree_from_node(node);
-		struct wlr_scene_node *child;
-		wl_list_for_each(child, &scene_tree->children, link) {
-			scene_node_send_frame_done(child, scene_output, now);
-		}
-	}
-}
-
 void wlr_scene_output_send_frame_done(struct wlr_scene_output *scene_output,
 		struct timespec *now) {
-	scene_node_send_frame_done(&scene_output->scene->tree.node,
-		scene_output, now);
+	struct wlr_scene_buffer *scene_buffer, *tmp;
+	wl_list_for_each_safe(scene_buffer, tmp,
+			&scene_output->primary_buffers, primary_output_link) {
+		wlr_scene_buffer_send_frame_done(scene_buffer, now);
+	}
 }
 
 static void scene_output_for_each_scene_buffer(const struct wlr_box *output_box,
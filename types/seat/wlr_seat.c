@@ -13,6 +13,55 @@
 
 #define SEAT_VERSION 9
 
+#define SEAT_CLIENT_BUCKETS_MIN 16
+
+static size_t client_bucket_index(size_t len, struct wl_client *client) {
+	// Fibonacci hashing, the low bits of pointers are mostly zero
+	uint64_t hash = (uint64_t)(uintptr_t)client * 0x9E3779B97F4A7C15ull;
+	return (hash >> 32) % len;
+}
+
+static struct wl_list *seat_client_bucket(struct wlr_seat *seat,
+		struct wl_client *client) {
+	return &seat->client_buckets[client_bucket_index(
+		seat->client_buckets_len, client)];
+}
+
+static struct wl_list *client_buckets_create(size_t len) {
+	struct wl_list *buckets = calloc(len, sizeof(*buckets));
+	if (buckets == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < len; i++) {
+		wl_list_init(&buckets[i]);
+	}
+	return buckets;
+}
+
+static void seat_grow_client_buckets(struct wlr_seat *seat) {
+	size_t len = 2 * seat->client_buckets_len;
+	struct wl_list *buckets = client_buckets_create(len);
+	if (buckets == NULL) {
+		// Not fatal, buckets will just get longer
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return;
+	}
+
+	for (size_t i = 0; i < seat->client_buckets_len; i++) {
+		struct wlr_seat_client *seat_client, *tmp;
+		wl_list_for_each_safe(seat_client, tmp, &seat->client_buckets[i],
+				bucket_link) {
+			size_t j = client_bucket_index(len, seat_client->client);
+			wl_list_remove(&seat_client->bucket_link);
+			wl_list_insert(&buckets[j], &seat_client->bucket_link);
+		}
+	}
+
+	free(seat->client_buckets);
+	seat->client_buckets = buckets;
+	seat->client_buckets_len = len;
+}
+
 static void seat_handle_get_pointer(struct wl_client *client,
 		struct wl_resource *seat_resource, uint32_t id) {
 	uint32_t version = wl_resource_get_version(seat_resource);
@@ -106,6 +155,8 @@ static void seat_client_destroy(struct wlr_seat_client *client) {
 	}
 
 	wl_list_remove(&client->link);
+	wl_list_remove(&client->bucket_link);
+	client->seat->clients_len--;
 	free(client);
 }
 
@@ -155,6 +206,13 @@ static struct wlr_seat_client *seat_client_create(struct wlr_seat *wlr_seat,
 
 	wl_list_insert(&wlr_seat->clients, &seat_client->link);
 
+	if (wlr_seat->clients_len >= wlr_seat->client_buckets_len) {
+		seat_grow_client_buckets(wlr_seat);
+	}
+	wl_list_insert(seat_client_bucket(wlr_seat, client),
+		&seat_client->bucket_link);
+	wlr_seat->clients_len++;
+
 	struct wlr_surface *pointer_focus =
 		wlr_seat->pointer_state.focused_surface;
 	if (pointer_focus != NULL &&
@@ -241,6 +299,7 @@ void wlr_seat_destroy(struct wlr_seat *seat) {
 	free(seat->pointer_state.default_grab);
 	free(seat->keyboard_state.default_grab);
 	free(seat->touch_state.default_grab);
+	free(seat->client_buckets);
 	free(seat->name);
 	free(seat);
 }
@@ -306,9 +365,20 @@ struct wlr_seat *wlr_seat_create(struct wl_display *display, const char *name) {
 	seat->touch_state.seat = seat;
 	wl_list_init(&seat->touch_state.touch_points);
 
+	seat->client_buckets = client_buckets_create(SEAT_CLIENT_BUCKETS_MIN);
+	if (seat->client_buckets == NULL) {
+		free(touch_grab);
+		free(pointer_grab);
+		free(keyboard_grab);
+		free(seat);
+		return NULL;
+	}
+	seat->client_buckets_len = SEAT_CLIENT_BUCKETS_MIN;
+
 	seat->global = wl_global_create(display, &wl_seat_interface,
 		SEAT_VERSION, seat, seat_handle_bind);
 	if (seat->global == NULL) {
+		free(seat->client_buckets);
 		free(touch_grab);
 		free(pointer_grab);
 		free(keyboard_grab);
@@ -351,7 +421,8 @@ struct wlr_seat *wlr_seat_create(struct wl_display *display, const char *name) {
 struct wlr_seat_client *wlr_seat_client_for_wl_client(struct wlr_seat *wlr_seat,
 		struct wl_client *wl_client) {
 	struct wlr_seat_client *seat_client;
-	wl_list_for_each(seat_client, &wlr_seat->clients, link) {
+	wl_list_for_each(seat_client, seat_client_bucket(wlr_seat, wl_client),
+			bucket_link) {
 		if (seat_client->client == wl_client) {
 			return seat_client;
 		}
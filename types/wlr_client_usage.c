@@ -0,0 +1,191 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wlr/types/wlr_client_usage.h>
+#include <wlr/util/log.h>
+#include "types/wlr_client_usage.h"
+
+static void usage_unref(struct wlr_client_usage *usage) {
+	assert(usage->n_refs > 0);
+	usage->n_refs--;
+	if (usage->n_refs > 0) {
+		return;
+	}
+
+	wl_list_remove(&usage->link);
+	free(usage);
+}
+
+static void usage_handle_client_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_client_usage *usage =
+		wl_container_of(listener, usage, client_destroy);
+	wl_list_remove(&usage->client_destroy.link);
+	usage->client = NULL;
+	usage_unref(usage);
+}
+
+static void manager_handle_display_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_client_usage_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	wl_signal_emit_mutable(&manager->events.destroy, NULL);
+
+	assert(wl_list_empty(&manager->events.over_budget.listener_list));
+	assert(wl_list_empty(&manager->events.destroy.listener_list));
+
+	// Some resources may outlive the display, e.g. buffers locked by the
+	// compositor: keep their usage around without a manager
+	struct wlr_client_usage *usage, *tmp;
+	wl_list_for_each_safe(usage, tmp, &manager->usages, link) {
+		usage->manager = NULL;
+		wl_list_remove(&usage->link);
+		wl_list_init(&usage->link);
+	}
+
+	wl_list_remove(&manager->display_destroy.link);
+	free(manager);
+}
+
+struct wlr_client_usage_manager *wlr_client_usage_manager_create(
+		struct wl_display *display) {
+	struct wlr_client_usage_manager *manager = calloc(1, sizeof(*manager));
+	if (manager == NULL) {
+		return NULL;
+	}
+
+	wl_list_init(&manager->usages);
+	wl_signal_init(&manager->events.over_budget);
+	wl_signal_init(&manager->events.destroy);
+
+	manager->display_destroy.notify = manager_handle_display_destroy;
+	wl_display_add_destroy_listener(display, &manager->display_destroy);
+
+	return manager;
+}
+
+static struct wlr_client_usage_manager *manager_from_client(
+		struct wl_client *client) {
+	struct wl_listener *listener = wl_display_get_destroy_listener(
+		wl_client_get_display(client), manager_handle_display_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_client_usage_manager *manager =
+		wl_container_of(listener, manager, display_destroy);
+	return manager;
+}
+
+static struct wlr_client_usage *usage_from_client(struct wl_client *client) {
+	struct wl_listener *listener =
+		wl_client_get_destroy_listener(client, usage_handle_client_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_client_usage *usage =
+		wl_container_of(listener, usage, client_destroy);
+	return usage;
+}
+
+struct wlr_client_usage *wlr_client_usage_manager_get_client(
+		struct wlr_client_usage_manager *manager, struct wl_client *client) {
+	struct wlr_client_usage *usage = usage_from_client(client);
+	if (usage == NULL || usage->manager != manager) {
+		return NULL;
+	}
+	return usage;
+}
+
+static struct wlr_client_usage *usage_get_or_create(struct wl_client *client) {
+	struct wlr_client_usage *usage = usage_from_client(client);
+	if (usage != NULL) {
+		return usage;
+	}
+
+	struct wlr_client_usage_manager *manager = manager_from_client(client);
+	if (manager == NULL) {
+		return NULL;
+	}
+
+	usage = calloc(1, sizeof(*usage));
+	if (usage == NULL) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		return NULL;
+	}
+
+	usage->client = client;
+	usage->manager = manager;
+	usage->n_refs = 1; // released when the client is destroyed
+	wl_list_insert(manager->usages.prev, &usage->link);
+
+	usage->client_destroy.notify = usage_handle_client_destroy;
+	wl_client_add_destroy_listener(client, &usage->client_destroy);
+
+	return usage;
+}
+
+void client_usage_charge_init(struct wlr_client_usage_charge *charge,
+		enum wlr_client_usage_type type) {
+	assert(type < WLR_CLIENT_USAGE_TYPE_COUNT);
+	*charge = (struct wlr_client_usage_charge){
+		.type = type,
+	};
+}
+
+bool client_usage_charge_set(struct wlr_client_usage_charge *charge,
+		struct wl_client *client, size_t size) {
+	struct wlr_client_usage *usage = charge->usage;
+	size_t charged = charge->size;
+	if (usage == NULL) {
+		// Nothing has been accounted yet, e.g. because the manager was
+		// created late. Only attach when the charge grows.
+		usage = size > charged ? usage_get_or_create(client) : NULL;
+		if (usage == NULL) {
+			charge->size = size;
+			return true;
+		}
+		charged = 0;
+	}
+
+	enum wlr_client_usage_type type = charge->type;
+	size_t prev = usage->current[type];
+	size_t next = prev - charged + size;
+
+	struct wlr_client_usage_manager *manager = usage->manager;
+	if (manager != NULL && usage->client != NULL && size > charged &&
+			manager->budget[type] != 0 && next > manager->budget[type]) {
+		struct wlr_client_usage_event_over_budget event = {
+			.usage = usage,
+			.type = type,
+			.requested = next,
+			.rejected = manager->enforce_budget,
+		};
+		if (event.rejected || prev <= manager->budget[type]) {
+			wl_signal_emit_mutable(&manager->events.over_budget, &event);
+		}
+		if (event.rejected) {
+			return false;
+		}
+	}
+
+	if (charge->usage == NULL) {
+		charge->usage = usage;
+		usage->n_refs++;
+	}
+
+	usage->current[type] = next;
+	if (next > usage->peak[type]) {
+		usage->peak[type] = next;
+	}
+	charge->size = size;
+	return true;
+}
+
+void client_usage_charge_finish(struct wlr_client_usage_charge *charge) {
+	struct wlr_client_usage *usage = charge->usage;
+	if (usage != NULL) {
+		usage->current[charge->type] -= charge->size;
+		usage_unref(usage);
+	}
+	charge->usage = NULL;
+	charge->size = 0;
+}
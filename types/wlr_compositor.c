@@ -1,6 +1,8 @@
 #include <assert.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/render/interface.h>
 #include <wlr/types/wlr_buffer.h>
@@ -10,7 +12,9 @@
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
 #include <wlr/util/transform.h>
+#include "render/dmabuf.h"
 #include "types/wlr_buffer.h"
+#include "types/wlr_client_usage.h"
 #include "types/wlr_region.h"
 #include "types/wlr_subcompositor.h"
 #include "util/array.h"
@@ -19,6 +23,9 @@
 #define COMPOSITOR_VERSION 6
 #define CALLBACK_VERSION 1
 
+// Maximum number of unused cached states kept per surface
+#define CACHED_STATE_POOL_CAP 4
+
 static int min(int fst, int snd) {
 	if (fst < snd) {
 		return fst;
@@ -315,11 +322,24 @@ static void surface_synced_move_state(struct wlr_surface_synced *synced,
 	}
 }
 
+static void surface_synced_merge_state(struct wlr_surface_synced *synced,
+		void *dst, void *src) {
+	if (synced->impl->merge_state) {
+		synced->impl->merge_state(dst, src);
+	} else {
+		surface_synced_move_state(synced, dst, src);
+	}
+}
+
 /**
  * Overwrite state with a copy of the next state, then clear the next state.
+ *
+ * If merge is true, the synced states of next are merged into the ones of
+ * state instead of overwriting them.
  */
 static void surface_state_move(struct wlr_surface_state *state,
-		struct wlr_surface_state *next, struct wlr_surface *surface) {
+		struct wlr_surface_state *next, struct wlr_surface *surface,
+		bool merge) {
 	state->width = next->width;
 	state->height = next->height;
 	state->buffer_width = next->buffer_width;
@@ -378,8 +398,13 @@ static void surface_state_move(struct wlr_surface_state *state,
 	void **next_synced = next->synced.data;
 	struct wlr_surface_synced *synced;
 	wl_list_for_each(synced, &surface->synced, link) {
-		surface_synced_move_state(synced,
-			state_synced[synced->index], next_synced[synced->index]);
+		if (merge) {
+			surface_synced_merge_state(synced,
+				state_synced[synced->index], next_synced[synced->index]);
+		} else {
+			surface_synced_move_state(synced,
+				state_synced[synced->index], next_synced[synced->index]);
+		}
 	}
 
 	// commit subsurface order
@@ -404,6 +429,82 @@ static void surface_state_move(struct wlr_surface_state *state,
 	next->cached_state_locks = 0;
 }
 
+static bool surface_state_can_merge(struct wlr_surface_state *state,
+		struct wlr_surface_state *next) {
+	// NULL buffer commits unmap the surface and reset role state, they need
+	// to be applied on their own
+	if ((state->committed & WLR_SURFACE_STATE_BUFFER) && state->buffer == NULL) {
+		return false;
+	}
+	if ((next->committed & WLR_SURFACE_STATE_BUFFER) && next->buffer == NULL) {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Merge the next state into state, as if both had been applied one after the
+ * other, then clear the next state.
+ */
+static void surface_state_merge(struct wlr_surface_state *state,
+		struct wlr_surface_state *next, struct wlr_surface *surface) {
+	// Surface damage may be expressed with different scales, transforms and
+	// viewports: convert both to buffer damage before merging them
+	pixman_region32_t damage, next_damage;
+	pixman_region32_init(&damage);
+	pixman_region32_init(&next_damage);
+	surface_update_damage(&damage, state, state);
+	surface_update_damage(&next_damage, state, next);
+	if (state->buffer_width == next->buffer_width &&
+			state->buffer_height == next->buffer_height) {
+		pixman_region32_union(&damage, &damage, &next_damage);
+	} else {
+		pixman_region32_fini(&damage);
+		pixman_region32_init_rect(&damage, 0, 0,
+			next->buffer_width, next->buffer_height);
+	}
+	pixman_region32_fini(&next_damage);
+
+	uint32_t committed = state->committed | next->committed;
+	int32_t dx = state->dx + next->dx;
+	int32_t dy = state->dy + next->dy;
+
+	surface_state_move(state, next, surface, true);
+
+	if (committed & WLR_SURFACE_STATE_OFFSET) {
+		state->dx = dx;
+		state->dy = dy;
+	}
+
+	pixman_region32_clear(&state->surface_damage);
+	pixman_region32_copy(&state->buffer_damage, &damage);
+	pixman_region32_fini(&damage);
+	if (committed & (WLR_SURFACE_STATE_SURFACE_DAMAGE |
+			WLR_SURFACE_STATE_BUFFER_DAMAGE)) {
+		committed &= ~WLR_SURFACE_STATE_SURFACE_DAMAGE;
+		committed |= WLR_SURFACE_STATE_BUFFER_DAMAGE;
+	}
+	state->committed = committed;
+}
+
+static void surface_update_texture_usage(struct wlr_surface *surface,
+		struct wlr_buffer *source) {
+	size_t size = 0;
+	struct wlr_dmabuf_attributes dmabuf;
+	if (surface->buffer != NULL && !wlr_buffer_get_dmabuf(source, &dmabuf)) {
+		// The texture layout is up to the renderer, assume 4 bytes per
+		// pixel. DMA-BUFs are imported without a copy and are accounted by
+		// wlr_linux_dmabuf_v1.
+		struct wlr_texture *texture = surface->buffer->texture;
+		size = (size_t)texture->width * texture->height * 4;
+	}
+
+	struct wl_client *client = wl_resource_get_client(surface->resource);
+	if (!client_usage_charge_set(&surface->usage_texture, client, size)) {
+		wl_resource_post_no_memory(surface->resource);
+	}
+}
+
 static void surface_apply_damage(struct wlr_surface *surface) {
 	if (surface->current.buffer == NULL) {
 		// NULL commit
@@ -412,36 +513,54 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		}
 		surface->buffer = NULL;
 		surface->opaque = false;
+		surface_update_texture_usage(surface, NULL);
 		return;
 	}
 
 	surface->opaque = buffer_is_opaque(surface->current.buffer);
 
-	if (surface->buffer != NULL) {
-		if (wlr_client_buffer_apply_damage(surface->buffer,
-				surface->current.buffer, &surface->buffer_damage)) {
-			wlr_buffer_unlock(surface->current.buffer);
-			surface->current.buffer = NULL;
-			return;
+	struct wlr_compositor *compositor = surface->compositor;
+	struct wlr_client_buffer *buffer;
+	if (compositor->buffer_pool != NULL) {
+		if (surface->buffer_history == NULL) {
+			surface->buffer_history = calloc(1, sizeof(*surface->buffer_history));
+			if (surface->buffer_history == NULL) {
+				wl_resource_post_no_memory(surface->resource);
+				return;
+			}
+			client_buffer_history_init(surface->buffer_history);
 		}
-	}
 
-	if (surface->compositor->renderer == NULL) {
+		buffer = client_buffer_update(compositor->buffer_pool,
+			surface->buffer_history, surface->buffer, surface->current.buffer,
+			&surface->buffer_damage, &compositor->upload_stats);
+	} else if (surface->buffer != NULL && wlr_client_buffer_apply_damage(
+			surface->buffer, surface->current.buffer, &surface->buffer_damage)) {
+		buffer = surface->buffer;
+	} else if (compositor->renderer != NULL) {
+		// The buffer pool couldn't be created, upload without it
+		buffer = wlr_client_buffer_create(surface->current.buffer,
+			compositor->renderer);
+	} else {
 		return;
 	}
-
-	struct wlr_client_buffer *buffer = wlr_client_buffer_create(
-			surface->current.buffer, surface->compositor->renderer);
-
 	if (buffer == NULL) {
 		wlr_log(WLR_ERROR, "Failed to upload buffer");
 		return;
 	}
 
+	if (buffer == surface->buffer) {
+		// Updated in-place
+		wlr_buffer_unlock(surface->current.buffer);
+		surface->current.buffer = NULL;
+		return;
+	}
+
 	if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
 	surface->buffer = buffer;
+	surface_update_texture_usage(surface, surface->current.buffer);
 }
 
 static void surface_update_opaque_region(struct wlr_surface *surface) {
@@ -472,12 +591,41 @@ static bool surface_state_init(struct wlr_surface_state *state,
 	struct wlr_surface *surface);
 static void surface_state_finish(struct wlr_surface_state *state);
 
+static struct wlr_surface_state *surface_alloc_cached(
+		struct wlr_surface *surface) {
+	if (wl_list_empty(&surface->cached_pool)) {
+		return calloc(1, sizeof(struct wlr_surface_state));
+	}
+	struct wlr_surface_state *state =
+		wl_container_of(surface->cached_pool.next, state, cached_state_link);
+	wl_list_remove(&state->cached_state_link);
+	surface->cached_pool_len--;
+	return state;
+}
+
+static void surface_free_cached(struct wlr_surface *surface,
+		struct wlr_surface_state *state) {
+	if (surface->cached_pool_len >= CACHED_STATE_POOL_CAP) {
+		free(state);
+		return;
+	}
+	wl_list_insert(&surface->cached_pool, &state->cached_state_link);
+	surface->cached_pool_len++;
+}
+
 static void surface_cache_pending(struct wlr_surface *surface) {
-	struct wlr_surface_state *cached = calloc(1, sizeof(*cached));
-	if (!cached) {
+	struct wl_client *client = wl_resource_get_client(surface->resource);
+	size_t n_cached = surface->usage_cached_states.size;
+	if (!client_usage_charge_set(&surface->usage_cached_states, client,
+			n_cached + 1)) {
 		goto error;
 	}
 
+	struct wlr_surface_state *cached = surface_alloc_cached(surface);
+	if (!cached) {
+		goto error_charge;
+	}
+
 	if (!surface_state_init(cached, surface)) {
 		goto error_cached;
 	}
@@ -492,7 +640,7 @@ static void surface_cache_pending(struct wlr_surface *surface) {
 		cached_synced[synced->index] = synced_state;
 	}
 
-	surface_state_move(cached, &surface->pending, surface);
+	surface_state_move(cached, &surface->pending, surface, false);
 
 	wl_list_insert(surface->cached.prev, &cached->cached_state_link);
 
@@ -503,7 +651,9 @@ static void surface_cache_pending(struct wlr_surface *surface) {
 error_state:
 	surface_state_finish(cached);
 error_cached:
-	free(cached);
+	surface_free_cached(surface, cached);
+error_charge:
+	client_usage_charge_set(&surface->usage_cached_states, client, n_cached);
 error:
 	wl_resource_post_no_memory(surface->resource);
 }
@@ -530,7 +680,7 @@ static void surface_commit_state(struct wlr_surface *surface,
 	surface->previous.buffer_width = surface->current.buffer_width;
 	surface->previous.buffer_height = surface->current.buffer_height;
 
-	surface_state_move(&surface->current, next, surface);
+	surface_state_move(&surface->current, next, surface, false);
 
 	if (invalid_buffer) {
 		surface_apply_damage(surface);
@@ -566,6 +716,93 @@ static void surface_commit_state(struct wlr_surface *surface,
 	surface->current.buffer = NULL;
 }
 
+struct wlr_surface_fence_wait {
+	struct wlr_surface *surface;
+	uint32_t seq;
+	int fd;
+	struct wl_event_source *event_source;
+	struct wl_list link; // wlr_surface.fence_waits
+};
+
+static void surface_fence_wait_destroy(struct wlr_surface_fence_wait *wait) {
+	wl_event_source_remove(wait->event_source);
+	close(wait->fd);
+	wl_list_remove(&wait->link);
+	free(wait);
+}
+
+static int surface_fence_wait_handle_event(int fd, uint32_t mask, void *data) {
+	struct wlr_surface_fence_wait *wait = data;
+	struct wlr_surface *surface = wait->surface;
+	uint32_t seq = wait->seq;
+
+	// The fence has signaled (or errored out, in which case there is nothing
+	// to wait for anymore)
+	surface_fence_wait_destroy(wait);
+	wlr_surface_unlock_cached(surface, seq);
+	return 0;
+}
+
+static void surface_wait_dmabuf_fence(struct wlr_surface *surface, int dmabuf_fd) {
+	int sync_file_fd = dmabuf_export_sync_file(dmabuf_fd, DMA_BUF_SYNC_READ);
+	if (sync_file_fd < 0) {
+		return;
+	}
+
+	// Don't bother locking the state if the fence has already signaled
+	struct pollfd pollfd = { .fd = sync_file_fd, .events = POLLIN };
+	if (poll(&pollfd, 1, 0) != 0) {
+		close(sync_file_fd);
+		return;
+	}
+
+	struct wlr_surface_fence_wait *wait = calloc(1, sizeof(*wait));
+	if (wait == NULL) {
+		close(sync_file_fd);
+		return;
+	}
+
+	wait->event_source = wl_event_loop_add_fd(surface->compositor->event_loop,
+		sync_file_fd, WL_EVENT_READABLE, surface_fence_wait_handle_event, wait);
+	if (wait->event_source == NULL) {
+		free(wait);
+		close(sync_file_fd);
+		return;
+	}
+
+	wait->surface = surface;
+	wait->fd = sync_file_fd;
+	wait->seq = wlr_surface_lock_pending(surface);
+	wl_list_insert(&surface->fence_waits, &wait->link);
+}
+
+static void surface_wait_dmabuf_fences(struct wlr_surface *surface) {
+	struct wlr_surface_state *pending = &surface->pending;
+	if (!surface->compositor->wait_dmabuf_fences ||
+			!(pending->committed & WLR_SURFACE_STATE_BUFFER) ||
+			pending->buffer == NULL) {
+		return;
+	}
+
+	struct wlr_dmabuf_attributes dmabuf;
+	if (!wlr_buffer_get_dmabuf(pending->buffer, &dmabuf)) {
+		return;
+	}
+
+	for (int i = 0; i < dmabuf.n_planes; i++) {
+		bool dup = false;
+		for (int j = 0; j < i; j++) {
+			if (dmabuf.fd[j] == dmabuf.fd[i]) {
+				dup = true;
+				break;
+			}
+		}
+		if (!dup) {
+			surface_wait_dmabuf_fence(surface, dmabuf.fd[i]);
+		}
+	}
+}
+
 static void surface_handle_commit(struct wl_client *client,
 		struct wl_resource *resource) {
 	struct wlr_surface *surface = wlr_surface_from_resource(resource);
@@ -585,6 +822,8 @@ static void surface_handle_commit(struct wl_client *client,
 		return;
 	}
 
+	surface_wait_dmabuf_fences(surface);
+
 	if (surface->pending.cached_state_locks > 0 || !wl_list_empty(&surface->cached)) {
 		surface_cache_pending(surface);
 	} else {
@@ -709,7 +948,11 @@ static void surface_state_destroy_cached(struct wlr_surface_state *state,
 
 	surface_state_finish(state);
 	wl_list_remove(&state->cached_state_link);
-	free(state);
+	surface_free_cached(surface, state);
+
+	struct wl_client *client = wl_resource_get_client(surface->resource);
+	client_usage_charge_set(&surface->usage_cached_states, client,
+		surface->usage_cached_states.size - 1);
 }
 
 static void surface_output_destroy(struct wlr_surface_output *surface_output);
@@ -731,10 +974,18 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 	wlr_addon_set_finish(&surface->addons);
 	assert(wl_list_empty(&surface->synced));
 
+	struct wlr_surface_fence_wait *wait, *wait_tmp;
+	wl_list_for_each_safe(wait, wait_tmp, &surface->fence_waits, link) {
+		surface_fence_wait_destroy(wait);
+	}
+
 	struct wlr_surface_state *cached, *cached_tmp;
 	wl_list_for_each_safe(cached, cached_tmp, &surface->cached, cached_state_link) {
 		surface_state_destroy_cached(cached, surface);
 	}
+	wl_list_for_each_safe(cached, cached_tmp, &surface->cached_pool, cached_state_link) {
+		free(cached);
+	}
 
 	wl_list_remove(&surface->role_resource_destroy.link);
 
@@ -748,6 +999,12 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 	if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
+	if (surface->buffer_history != NULL) {
+		client_buffer_history_finish(surface->buffer_history);
+		free(surface->buffer_history);
+	}
+	client_usage_charge_finish(&surface->usage_texture);
+	client_usage_charge_finish(&surface->usage_cached_states);
 	free(surface);
 }
 
@@ -784,6 +1041,11 @@ static struct wlr_surface *surface_create(struct wl_client *client,
 	wl_signal_init(&surface->events.new_subsurface);
 	wl_list_init(&surface->current_outputs);
 	wl_list_init(&surface->cached);
+	wl_list_init(&surface->cached_pool);
+	wl_list_init(&surface->fence_waits);
+	client_usage_charge_init(&surface->usage_texture, WLR_CLIENT_USAGE_TEXTURE);
+	client_usage_charge_init(&surface->usage_cached_states,
+		WLR_CLIENT_USAGE_CACHED_STATE);
 	pixman_region32_init(&surface->buffer_damage);
 	pixman_region32_init(&surface->opaque_region);
 	pixman_region32_init(&surface->input_region);
@@ -958,13 +1220,26 @@ void wlr_surface_unlock_cached(struct wlr_surface *surface, uint32_t seq) {
 		return;
 	}
 
-	// TODO: consider merging all committed states together
-	struct wlr_surface_state *next, *tmp;
-	wl_list_for_each_safe(next, tmp, &surface->cached, cached_state_link) {
+	while (!wl_list_empty(&surface->cached)) {
+		struct wlr_surface_state *next =
+			wl_container_of(surface->cached.next, next, cached_state_link);
 		if (next->cached_state_locks > 0) {
 			break;
 		}
 
+		// Squash all following ready states into this one, so that
+		// intermediate buffers are never uploaded
+		while (next->cached_state_link.next != &surface->cached) {
+			struct wlr_surface_state *later = wl_container_of(
+				next->cached_state_link.next, later, cached_state_link);
+			if (later->cached_state_locks > 0 ||
+					!surface_state_can_merge(next, later)) {
+				break;
+			}
+			surface_state_merge(next, later, surface);
+			surface_state_destroy_cached(later, surface);
+		}
+
 		surface_commit_state(surface, next);
 		surface_state_destroy_cached(next, surface);
 	}
@@ -1334,6 +1609,7 @@ static void compositor_handle_display_destroy(
 	wl_signal_emit_mutable(&compositor->events.destroy, NULL);
 	wl_list_remove(&compositor->display_destroy.link);
 	wl_list_remove(&compositor->renderer_destroy.link);
+	client_buffer_pool_destroy(compositor->buffer_pool);
 	wl_global_destroy(compositor->global);
 	free(compositor);
 }
@@ -1365,6 +1641,8 @@ struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 	wl_signal_init(&compositor->events.destroy);
 	wl_list_init(&compositor->renderer_destroy.link);
 
+	compositor->event_loop = wl_display_get_event_loop(display);
+
 	compositor->display_destroy.notify = compositor_handle_display_destroy;
 	wl_display_add_destroy_listener(display, &compositor->display_destroy);
 
@@ -1378,14 +1656,33 @@ void wlr_compositor_set_renderer(struct wlr_compositor *compositor,
 	wl_list_remove(&compositor->renderer_destroy.link);
 	compositor->renderer = renderer;
 
+	client_buffer_pool_destroy(compositor->buffer_pool);
+	compositor->buffer_pool = NULL;
+
 	if (renderer != NULL) {
 		compositor->renderer_destroy.notify = compositor_handle_renderer_destroy;
 		wl_signal_add(&renderer->events.destroy, &compositor->renderer_destroy);
+
+		compositor->buffer_pool = client_buffer_pool_create(renderer,
+			compositor->event_loop);
+		if (compositor->buffer_pool == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create client buffer pool");
+		}
 	} else {
 		wl_list_init(&compositor->renderer_destroy.link);
 	}
 }
 
+void wlr_compositor_set_wait_dmabuf_fences(struct wlr_compositor *compositor,
+		bool enabled) {
+	if (enabled && !dmabuf_check_sync_file_import_export()) {
+		wlr_log(WLR_INFO, "DMA-BUF sync_file export is not supported, "
+			"commits won't wait for DMA-BUF fences");
+		enabled = false;
+	}
+	compositor->wait_dmabuf_fences = enabled;
+}
+
 static bool surface_state_add_synced(struct wlr_surface_state *state, void *value) {
 	void **ptr = wl_array_add(&state->synced, sizeof(void *));
 	if (ptr == NULL) {
@@ -95,6 +95,9 @@ struct wlr_cursor_state {
 	struct {
 		int32_t x, y;
 	} surface_hotspot;
+	// the buffer backing the surface's current texture, locked, NULL if
+	// unknown or unusable by hardware cursors
+	struct wlr_buffer *surface_buffer;
 	struct wl_listener surface_commit;
 	struct wl_listener surface_destroy;
 
@@ -239,6 +242,8 @@ static void cursor_reset_image(struct wlr_cursor *cur) {
 	wl_list_init(&cur->state->surface_destroy.link);
 	wl_list_init(&cur->state->surface_commit.link);
 	cur->state->surface = NULL;
+	wlr_buffer_unlock(cur->state->surface_buffer);
+	cur->state->surface_buffer = NULL;
 
 	cur->state->xcursor_manager = NULL;
 	free(cur->state->xcursor_name);
@@ -533,7 +538,7 @@ static void cursor_output_cursor_update(struct wlr_cursor_output_cursor *output_
 		}
 
 		output_cursor_set_texture(output_cursor->output_cursor, texture, true,
-			&src_box, dst_width, dst_height, WL_OUTPUT_TRANSFORM_NORMAL,
+			buffer, &src_box, dst_width, dst_height, WL_OUTPUT_TRANSFORM_NORMAL,
 			hotspot_x, hotspot_y);
 	} else if (cur->state->surface != NULL) {
 		struct wlr_surface *surface = cur->state->surface;
@@ -548,7 +553,8 @@ static void cursor_output_cursor_update(struct wlr_cursor_output_cursor *output_
 		int dst_height = surface->current.height;
 
 		output_cursor_set_texture(output_cursor->output_cursor, texture, false,
-			&src_box, dst_width, dst_height, surface->current.transform,
+			cur->state->surface_buffer, &src_box, dst_width, dst_height,
+			surface->current.transform,
 			hotspot_x, hotspot_y);
 
 		if (output_cursor->output_cursor->visible) {
@@ -633,6 +639,20 @@ static void cursor_handle_surface_destroy(struct wl_listener *listener, void *da
 	wlr_cursor_unset_image(&state->cursor);
 }
 
+// The lock on the surface buffer delays wl_buffer.release, only take it if an
+// output may use the buffer for its hardware cursor
+static bool cursor_should_keep_surface_buffer(struct wlr_cursor *cur,
+		struct wlr_buffer *buffer) {
+	struct wlr_cursor_output_cursor *output_cursor;
+	wl_list_for_each(output_cursor, &cur->state->output_cursors, link) {
+		if (output_cursor_source_is_usable(
+				output_cursor->output_cursor->output, buffer)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 static void cursor_handle_surface_commit(struct wl_listener *listener, void *data) {
 	struct wlr_cursor_state *state = wl_container_of(listener, state, surface_commit);
 	struct wlr_surface *surface = state->surface;
@@ -640,6 +660,20 @@ static void cursor_handle_surface_commit(struct wl_listener *listener, void *dat
 	state->surface_hotspot.x -= surface->current.dx;
 	state->surface_hotspot.y -= surface->current.dy;
 
+	// The surface releases its buffer right after the commit event, keep it
+	// around so that it can be used as the cursor image source later on. It
+	// is NULL if the previous texture was updated in-place, or if no output
+	// can use it.
+	if (surface->current.committed & WLR_SURFACE_STATE_BUFFER) {
+		wlr_buffer_unlock(state->surface_buffer);
+		state->surface_buffer = NULL;
+		if (surface->current.buffer != NULL &&
+				cursor_should_keep_surface_buffer(&state->cursor,
+				surface->current.buffer)) {
+			state->surface_buffer = wlr_buffer_lock(surface->current.buffer);
+		}
+	}
+
 	cursor_update_outputs(&state->cursor);
 }
 
@@ -661,6 +695,10 @@ void wlr_cursor_set_surface(struct wlr_cursor *cur, struct wlr_surface *surface,
 		cursor_reset_image(cur);
 
 		cur->state->surface = surface;
+		if (surface->current.buffer != NULL &&
+				cursor_should_keep_surface_buffer(cur, surface->current.buffer)) {
+			cur->state->surface_buffer = wlr_buffer_lock(surface->current.buffer);
+		}
 
 		wl_signal_add(&surface->events.destroy, &cur->state->surface_destroy);
 		cur->state->surface_destroy.notify = cursor_handle_surface_destroy;
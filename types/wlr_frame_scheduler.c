@@ -0,0 +1,232 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/types/wlr_frame_scheduler.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "util/time.h"
+
+static const int64_t default_margin_ns = 2 * 1000 * 1000; // 2ms
+
+static int64_t predict_immediate(struct wlr_frame_scheduler *scheduler) {
+	return -1;
+}
+
+const struct wlr_frame_scheduler_policy wlr_frame_scheduler_policy_immediate = {
+	.predict_render_duration = predict_immediate,
+};
+
+static int64_t predict_max(struct wlr_frame_scheduler *scheduler) {
+	if (scheduler->render_durations_len == 0) {
+		return -1;
+	}
+	int64_t max = 0;
+	for (size_t i = 0; i < scheduler->render_durations_len; i++) {
+		if (scheduler->render_durations[i] > max) {
+			max = scheduler->render_durations[i];
+		}
+	}
+	return max;
+}
+
+const struct wlr_frame_scheduler_policy wlr_frame_scheduler_policy_max = {
+	.predict_render_duration = predict_max,
+};
+
+static int64_t predict_average(struct wlr_frame_scheduler *scheduler) {
+	if (scheduler->render_durations_len == 0) {
+		return -1;
+	}
+	int64_t sum = 0;
+	for (size_t i = 0; i < scheduler->render_durations_len; i++) {
+		sum += scheduler->render_durations[i];
+	}
+	return sum / (int64_t)scheduler->render_durations_len;
+}
+
+const struct wlr_frame_scheduler_policy wlr_frame_scheduler_policy_average = {
+	.predict_render_duration = predict_average,
+};
+
+static int64_t get_now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
+
+static void scheduler_send_frame(struct wlr_frame_scheduler *scheduler) {
+	scheduler->stats.frames++;
+	if (scheduler->output->enabled) {
+		wl_signal_emit_mutable(&scheduler->events.frame, scheduler->output);
+	}
+}
+
+static int handle_timer(void *data) {
+	struct wlr_frame_scheduler *scheduler = data;
+	scheduler->timer_armed = false;
+	scheduler_send_frame(scheduler);
+	return 0;
+}
+
+// Returns how long the frame event should be delayed, in nanoseconds
+static int64_t scheduler_get_delay(struct wlr_frame_scheduler *scheduler) {
+	scheduler->deadline_ns = 0;
+
+	int64_t refresh = scheduler->refresh_ns;
+	if (refresh <= 0 && scheduler->output->refresh > 0) {
+		refresh = 1000000000000ll / scheduler->output->refresh;
+	}
+	if (refresh <= 0 || scheduler->last_present_ns == 0) {
+		return 0;
+	}
+
+	int64_t render_duration =
+		scheduler->policy->predict_render_duration(scheduler);
+	if (render_duration < 0) {
+		return 0;
+	}
+
+	// Extrapolate the next refresh cycle from the last presentation
+	int64_t now = get_now_ns();
+	int64_t deadline = scheduler->last_present_ns + refresh;
+	if (now >= deadline) {
+		deadline += (now - deadline) / refresh * refresh + refresh;
+	}
+
+	int64_t delay = deadline - render_duration - scheduler->margin_ns - now;
+	if (delay <= 0) {
+		return 0;
+	}
+	scheduler->deadline_ns = deadline;
+	return delay;
+}
+
+static void scheduler_handle_output_frame(struct wl_listener *listener,
+		void *data) {
+	struct wlr_frame_scheduler *scheduler =
+		wl_container_of(listener, scheduler, output_frame);
+	if (scheduler->timer_armed) {
+		return;
+	}
+
+	int64_t delay = scheduler_get_delay(scheduler);
+	// Round down, it's better to wake up a bit too early than too late
+	int delay_ms = delay / 1000000;
+	scheduler->stats.last_delay_ns = delay_ms > 0 ? delay : 0;
+	if (delay_ms <= 0 || scheduler->timer == NULL) {
+		scheduler_send_frame(scheduler);
+		return;
+	}
+
+	scheduler->stats.delayed_frames++;
+	scheduler->timer_armed = true;
+	wl_event_source_timer_update(scheduler->timer, delay_ms);
+}
+
+static void scheduler_handle_output_commit(struct wl_listener *listener,
+		void *data) {
+	struct wlr_frame_scheduler *scheduler =
+		wl_container_of(listener, scheduler, output_commit);
+	struct wlr_output_event_commit *event = data;
+
+	if (!(event->state->committed & WLR_OUTPUT_STATE_BUFFER) ||
+			scheduler->deadline_ns == 0) {
+		return;
+	}
+	if (timespec_to_nsec(event->when) > scheduler->deadline_ns) {
+		scheduler->stats.missed_deadlines++;
+	}
+	scheduler->deadline_ns = 0;
+}
+
+static void scheduler_handle_output_present(struct wl_listener *listener,
+		void *data) {
+	struct wlr_frame_scheduler *scheduler =
+		wl_container_of(listener, scheduler, output_present);
+	struct wlr_output_event_present *event = data;
+
+	if (!event->presented || event->when == NULL) {
+		return;
+	}
+	scheduler->last_present_ns = timespec_to_nsec(event->when);
+	scheduler->refresh_ns = event->refresh;
+}
+
+static void scheduler_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_frame_scheduler *scheduler =
+		wl_container_of(listener, scheduler, output_destroy);
+	wlr_frame_scheduler_destroy(scheduler);
+}
+
+struct wlr_frame_scheduler *wlr_frame_scheduler_create(struct wlr_output *output,
+		const struct wlr_frame_scheduler_policy *policy) {
+	struct wlr_frame_scheduler *scheduler = calloc(1, sizeof(*scheduler));
+	if (scheduler == NULL) {
+		return NULL;
+	}
+
+	scheduler->timer = wl_event_loop_add_timer(output->event_loop,
+		handle_timer, scheduler);
+	if (scheduler->timer == NULL) {
+		free(scheduler);
+		return NULL;
+	}
+
+	scheduler->output = output;
+	scheduler->policy = policy != NULL ? policy : &wlr_frame_scheduler_policy_max;
+	scheduler->margin_ns = default_margin_ns;
+
+	wl_signal_init(&scheduler->events.frame);
+	wl_signal_init(&scheduler->events.destroy);
+
+	scheduler->output_frame.notify = scheduler_handle_output_frame;
+	wl_signal_add(&output->events.frame, &scheduler->output_frame);
+	scheduler->output_commit.notify = scheduler_handle_output_commit;
+	wl_signal_add(&output->events.commit, &scheduler->output_commit);
+	scheduler->output_present.notify = scheduler_handle_output_present;
+	wl_signal_add(&output->events.present, &scheduler->output_present);
+	scheduler->output_destroy.notify = scheduler_handle_output_destroy;
+	wl_signal_add(&output->events.destroy, &scheduler->output_destroy);
+
+	return scheduler;
+}
+
+void wlr_frame_scheduler_destroy(struct wlr_frame_scheduler *scheduler) {
+	if (scheduler == NULL) {
+		return;
+	}
+
+	wl_signal_emit_mutable(&scheduler->events.destroy, NULL);
+
+	assert(wl_list_empty(&scheduler->events.destroy.listener_list));
+
+	wl_list_remove(&scheduler->output_frame.link);
+	wl_list_remove(&scheduler->output_commit.link);
+	wl_list_remove(&scheduler->output_present.link);
+	wl_list_remove(&scheduler->output_destroy.link);
+	wl_event_source_remove(scheduler->timer);
+	free(scheduler);
+}
+
+void wlr_frame_scheduler_set_policy(struct wlr_frame_scheduler *scheduler,
+		const struct wlr_frame_scheduler_policy *policy) {
+	scheduler->policy = policy != NULL ? policy : &wlr_frame_scheduler_policy_max;
+}
+
+void wlr_frame_scheduler_inform_render(struct wlr_frame_scheduler *scheduler,
+		int64_t duration_ns) {
+	if (duration_ns < 0) {
+		return;
+	}
+
+	size_t len = scheduler->render_durations_len;
+	if (len == WLR_FRAME_SCHEDULER_HISTORY) {
+		memmove(&scheduler->render_durations[0], &scheduler->render_durations[1],
+			(len - 1) * sizeof(scheduler->render_durations[0]));
+		len--;
+	}
+	scheduler->render_durations[len] = duration_ns;
+	scheduler->render_durations_len = len + 1;
+}
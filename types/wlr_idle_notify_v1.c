@@ -3,6 +3,7 @@
 #include <wlr/types/wlr_idle_notify_v1.h>
 #include <wlr/types/wlr_seat.h>
 #include "ext-idle-notify-v1-protocol.h"
+#include "util/time.h"
 
 #define IDLE_NOTIFIER_VERSION 1
 
@@ -14,6 +15,9 @@ struct wlr_idle_notification_v1 {
 
 	uint32_t timeout_ms;
 	struct wl_event_source *timer;
+	// Re-arming the timer on each input event is expensive: instead, the
+	// time of the last activity is recorded and checked when the timer fires
+	int64_t last_activity_ms;
 
 	bool idle;
 
@@ -63,6 +67,14 @@ static void notification_set_idle(struct wlr_idle_notification_v1 *notification,
 
 static int notification_handle_timer(void *data) {
 	struct wlr_idle_notification_v1 *notification = data;
+
+	int64_t idle_ms = get_current_time_msec() - notification->last_activity_ms;
+	if (idle_ms < notification->timeout_ms) {
+		wl_event_source_timer_update(notification->timer,
+			notification->timeout_ms - idle_ms);
+		return 0;
+	}
+
 	notification_set_idle(notification, true);
 	return 0;
 }
@@ -89,6 +101,7 @@ static void notification_reset_timer(struct wlr_idle_notification_v1 *notificati
 		return;
 	}
 
+	notification->last_activity_ms = get_current_time_msec();
 	if (notification->timer != NULL) {
 		wl_event_source_timer_update(notification->timer,
 			notification->timeout_ms);
@@ -98,6 +111,12 @@ static void notification_reset_timer(struct wlr_idle_notification_v1 *notificati
 }
 
 static void notification_handle_activity(struct wlr_idle_notification_v1 *notification) {
+	if (!notification->idle && notification->timer != NULL) {
+		// The timer is armed, it'll be pushed back when it fires
+		notification->last_activity_ms = get_current_time_msec();
+		return;
+	}
+
 	notification_set_idle(notification, false);
 	notification_reset_timer(notification);
 }
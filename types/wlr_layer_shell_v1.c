@@ -402,9 +402,17 @@ static void surface_synced_move_state(void *_dst, void *_src) {
 	src->committed = 0;
 }
 
+static void surface_synced_merge_state(void *_dst, void *_src) {
+	struct wlr_layer_surface_v1_state *dst = _dst, *src = _src;
+	uint32_t committed = dst->committed | src->committed;
+	surface_synced_move_state(dst, src);
+	dst->committed = committed;
+}
+
 static const struct wlr_surface_synced_impl surface_synced_impl = {
 	.state_size = sizeof(struct wlr_layer_surface_v1_state),
 	.move_state = surface_synced_move_state,
+	.merge_state = surface_synced_merge_state,
 };
 
 static void layer_shell_handle_get_layer_surface(struct wl_client *wl_client,
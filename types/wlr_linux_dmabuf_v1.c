@@ -2,6 +2,7 @@
 #include <drm_fourcc.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wlr/backend.h>
@@ -15,6 +16,7 @@
 #include <xf86drm.h>
 #include "linux-dmabuf-v1-protocol.h"
 #include "render/drm_format_set.h"
+#include "types/wlr_client_usage.h"
 #include "util/shm.h"
 
 #if WLR_HAS_DRM_BACKEND
@@ -37,6 +39,14 @@ struct wlr_linux_dmabuf_feedback_v1_compiled_tranche {
 };
 
 struct wlr_linux_dmabuf_feedback_v1_compiled {
+	struct wl_list link; // wlr_linux_dmabuf_v1.compiled_feedbacks
+	size_t n_refs;
+
+	// Serialized source feedback, used to share identical compiled feedback
+	// between surfaces
+	uint64_t hash;
+	struct wl_array key; // uint64_t
+
 	dev_t main_device;
 	int table_fd;
 	size_t table_size;
@@ -107,6 +117,7 @@ static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
 	}
 	wlr_dmabuf_attributes_finish(&buffer->attributes);
 	wl_list_remove(&buffer->release.link);
+	client_usage_charge_finish(&buffer->usage_charge);
 	free(buffer);
 }
 
@@ -354,13 +365,27 @@ static void params_create_common(struct wl_resource *params_resource,
 		wl_resource_post_no_memory(params_resource);
 		goto err_failed;
 	}
-	wlr_buffer_init(&buffer->base, &buffer_impl, attribs.width, attribs.height);
 
+	// The actual allocation size is unknown, estimate it from the planes
+	// (this over-estimates subsampled planes)
+	size_t usage_size = 0;
+	for (int i = 0; i < attribs.n_planes; i++) {
+		usage_size += (size_t)attribs.stride[i] * attribs.height;
+	}
 	struct wl_client *client = wl_resource_get_client(params_resource);
+	client_usage_charge_init(&buffer->usage_charge, WLR_CLIENT_USAGE_DMABUF);
+	if (!client_usage_charge_set(&buffer->usage_charge, client, usage_size)) {
+		free(buffer);
+		goto err_failed;
+	}
+
+	wlr_buffer_init(&buffer->base, &buffer_impl, attribs.width, attribs.height);
+
 	buffer->resource = wl_resource_create(client, &wl_buffer_interface,
 		1, buffer_id);
 	if (!buffer->resource) {
 		wl_resource_post_no_memory(params_resource);
+		client_usage_charge_finish(&buffer->usage_charge);
 		free(buffer);
 		goto err_failed;
 	}
@@ -507,6 +532,64 @@ static ssize_t get_drm_format_set_index(const struct wlr_drm_format_set *set,
 	return -1;
 }
 
+static bool feedback_key_add(struct wl_array *key, uint64_t value) {
+	uint64_t *ptr = wl_array_add(key, sizeof(value));
+	if (ptr == NULL) {
+		return false;
+	}
+	*ptr = value;
+	return true;
+}
+
+static bool feedback_build_key(struct wl_array *key,
+		const struct wlr_linux_dmabuf_feedback_v1 *feedback) {
+	const struct wlr_linux_dmabuf_feedback_v1_tranche *tranches = feedback->tranches.data;
+	size_t tranches_len = feedback->tranches.size / sizeof(struct wlr_linux_dmabuf_feedback_v1_tranche);
+
+	wl_array_init(key);
+	if (!feedback_key_add(key, feedback->main_device) ||
+			!feedback_key_add(key, tranches_len)) {
+		goto error;
+	}
+	for (size_t i = 0; i < tranches_len; i++) {
+		const struct wlr_linux_dmabuf_feedback_v1_tranche *tranche = &tranches[i];
+		if (!feedback_key_add(key, tranche->target_device) ||
+				!feedback_key_add(key, tranche->flags) ||
+				!feedback_key_add(key, tranche->formats.len)) {
+			goto error;
+		}
+		for (size_t j = 0; j < tranche->formats.len; j++) {
+			const struct wlr_drm_format *fmt = &tranche->formats.formats[j];
+			if (!feedback_key_add(key, fmt->format) ||
+					!feedback_key_add(key, fmt->len)) {
+				goto error;
+			}
+			for (size_t k = 0; k < fmt->len; k++) {
+				if (!feedback_key_add(key, fmt->modifiers[k])) {
+					goto error;
+				}
+			}
+		}
+	}
+	return true;
+
+error:
+	wlr_log(WLR_ERROR, "Failed to allocate feedback key");
+	wl_array_release(key);
+	return false;
+}
+
+static uint64_t feedback_key_hash(const struct wl_array *key) {
+	// 64-bit FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	const uint8_t *data = key->data;
+	for (size_t i = 0; i < key->size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
 static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 		const struct wlr_linux_dmabuf_feedback_v1 *feedback) {
 	const struct wlr_linux_dmabuf_feedback_v1_tranche *tranches = feedback->tranches.data;
@@ -573,6 +656,9 @@ static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile(
 		goto err_all_formats;
 	}
 
+	wl_list_init(&compiled->link);
+	wl_array_init(&compiled->key);
+	compiled->n_refs = 1;
 	compiled->main_device = feedback->main_device;
 	compiled->tranches_len = tranches_len;
 	compiled->table_fd = ro_fd;
@@ -626,18 +712,61 @@ err_all_formats:
 	return NULL;
 }
 
-static void compiled_feedback_destroy(
+static void compiled_feedback_unref(
 		struct wlr_linux_dmabuf_feedback_v1_compiled *feedback) {
 	if (feedback == NULL) {
 		return;
 	}
+	assert(feedback->n_refs > 0);
+	feedback->n_refs--;
+	if (feedback->n_refs > 0) {
+		return;
+	}
 	for (size_t i = 0; i < feedback->tranches_len; i++) {
 		wl_array_release(&feedback->tranches[i].indices);
 	}
+	wl_list_remove(&feedback->link);
+	wl_array_release(&feedback->key);
 	close(feedback->table_fd);
 	free(feedback);
 }
 
+/**
+ * Get a reference to the compiled version of the feedback. Compiled feedback
+ * is shared between all users with identical feedback, so that only the first
+ * one pays for compilation and the format table allocation.
+ */
+static struct wlr_linux_dmabuf_feedback_v1_compiled *feedback_compile_shared(
+		struct wlr_linux_dmabuf_v1 *linux_dmabuf,
+		const struct wlr_linux_dmabuf_feedback_v1 *feedback) {
+	struct wl_array key;
+	if (!feedback_build_key(&key, feedback)) {
+		return NULL;
+	}
+	uint64_t hash = feedback_key_hash(&key);
+
+	struct wlr_linux_dmabuf_feedback_v1_compiled *compiled;
+	wl_list_for_each(compiled, &linux_dmabuf->compiled_feedbacks, link) {
+		if (compiled->hash == hash && compiled->key.size == key.size &&
+				memcmp(compiled->key.data, key.data, key.size) == 0) {
+			wl_array_release(&key);
+			compiled->n_refs++;
+			return compiled;
+		}
+	}
+
+	compiled = feedback_compile(feedback);
+	if (compiled == NULL) {
+		wl_array_release(&key);
+		return NULL;
+	}
+
+	compiled->hash = hash;
+	compiled->key = key;
+	wl_list_insert(&linux_dmabuf->compiled_feedbacks, &compiled->link);
+	return compiled;
+}
+
 static void feedback_tranche_send(
 		const struct wlr_linux_dmabuf_feedback_v1_compiled_tranche *tranche,
 		struct wl_resource *resource) {
@@ -696,7 +825,7 @@ static void surface_destroy(struct wlr_linux_dmabuf_v1_surface *surface) {
 		wl_list_init(link);
 	}
 
-	compiled_feedback_destroy(surface->feedback);
+	compiled_feedback_unref(surface->feedback);
 
 	wlr_addon_finish(&surface->addon);
 	wl_list_remove(&surface->link);
@@ -865,7 +994,7 @@ static void linux_dmabuf_v1_destroy(struct wlr_linux_dmabuf_v1 *linux_dmabuf) {
 		surface_destroy(surface);
 	}
 
-	compiled_feedback_destroy(linux_dmabuf->default_feedback);
+	compiled_feedback_unref(linux_dmabuf->default_feedback);
 	wlr_drm_format_set_finish(&linux_dmabuf->default_formats);
 	if (linux_dmabuf->main_device_fd >= 0) {
 		close(linux_dmabuf->main_device_fd);
@@ -885,7 +1014,8 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
 
 static bool set_default_feedback(struct wlr_linux_dmabuf_v1 *linux_dmabuf,
 		const struct wlr_linux_dmabuf_feedback_v1 *feedback) {
-	struct wlr_linux_dmabuf_feedback_v1_compiled *compiled = feedback_compile(feedback);
+	struct wlr_linux_dmabuf_feedback_v1_compiled *compiled =
+		feedback_compile_shared(linux_dmabuf, feedback);
 	if (compiled == NULL) {
 		return false;
 	}
@@ -927,7 +1057,7 @@ static bool set_default_feedback(struct wlr_linux_dmabuf_v1 *linux_dmabuf,
 		}
 	}
 
-	compiled_feedback_destroy(linux_dmabuf->default_feedback);
+	compiled_feedback_unref(linux_dmabuf->default_feedback);
 	linux_dmabuf->default_feedback = compiled;
 
 	if (linux_dmabuf->main_device_fd >= 0) {
@@ -943,7 +1073,7 @@ static bool set_default_feedback(struct wlr_linux_dmabuf_v1 *linux_dmabuf,
 error_formats:
 	wlr_drm_format_set_finish(&formats);
 error_compiled:
-	compiled_feedback_destroy(compiled);
+	compiled_feedback_unref(compiled);
 	return false;
 }
 
@@ -959,6 +1089,7 @@ struct wlr_linux_dmabuf_v1 *wlr_linux_dmabuf_v1_create(struct wl_display *displa
 	linux_dmabuf->main_device_fd = -1;
 
 	wl_list_init(&linux_dmabuf->surfaces);
+	wl_list_init(&linux_dmabuf->compiled_feedbacks);
 	wl_signal_init(&linux_dmabuf->events.destroy);
 
 	linux_dmabuf->global = wl_global_create(display, &zwp_linux_dmabuf_v1_interface,
@@ -1023,13 +1154,19 @@ bool wlr_linux_dmabuf_v1_set_surface_feedback(
 
 	struct wlr_linux_dmabuf_feedback_v1_compiled *compiled = NULL;
 	if (feedback != NULL) {
-		compiled = feedback_compile(feedback);
+		compiled = feedback_compile_shared(linux_dmabuf, feedback);
 		if (compiled == NULL) {
 			return false;
 		}
 	}
 
-	compiled_feedback_destroy(surface->feedback);
+	if (compiled == surface->feedback) {
+		// Same content as the feedback already sent to the client
+		compiled_feedback_unref(compiled);
+		return true;
+	}
+
+	compiled_feedback_unref(surface->feedback);
 	surface->feedback = compiled;
 
 	struct wl_resource *resource;
@@ -9,6 +9,9 @@
 
 static const struct wlr_addon_interface addon_impl;
 
+// Past this number of cells, queries fall back to walking the output list
+#define INDEX_MAX_CELLS (1 << 20)
+
 static void output_layout_handle_display_destroy(struct wl_listener *listener,
 		void *data) {
 	struct wlr_output_layout *layout = wl_container_of(listener, layout, display_destroy);
@@ -39,6 +42,8 @@ static void output_layout_output_destroy(
 	wlr_output_destroy_global(l_output->output);
 	wl_list_remove(&l_output->commit.link);
 	wl_list_remove(&l_output->link);
+	// The index is rebuilt when the layout is reconfigured
+	l_output->layout->index.valid = false;
 	wlr_addon_finish(&l_output->addon);
 	free(l_output);
 }
@@ -56,6 +61,9 @@ void wlr_output_layout_destroy(struct wlr_output_layout *layout) {
 	}
 
 	wl_list_remove(&layout->display_destroy.link);
+	free(layout->index.xs);
+	free(layout->index.ys);
+	free(layout->index.cells);
 	free(layout);
 }
 
@@ -68,6 +76,139 @@ static void output_layout_output_get_box(
 		&box->width, &box->height);
 }
 
+static int compare_int(const void *a, const void *b) {
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+static size_t sort_unique(int *values, size_t len) {
+	qsort(values, len, sizeof(values[0]), compare_int);
+	size_t n = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (n == 0 || values[n - 1] != values[i]) {
+			values[n++] = values[i];
+		}
+	}
+	return n;
+}
+
+// Find the index of the interval [edges[i], edges[i + 1]) containing v
+static bool find_interval(const int *edges, size_t len, double v, size_t *i) {
+	if (len < 2 || !(v >= edges[0] && v < edges[len - 1])) {
+		return false;
+	}
+	size_t lo = 0, hi = len - 1;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (v < edges[mid]) {
+			hi = mid;
+		} else {
+			lo = mid;
+		}
+	}
+	*i = lo;
+	return true;
+}
+
+static size_t find_edge(const int *edges, size_t len, int v) {
+	const int *edge = bsearch(&v, edges, len, sizeof(edges[0]), compare_int);
+	assert(edge != NULL);
+	return edge - edges;
+}
+
+static void output_layout_rebuild_index(struct wlr_output_layout *layout) {
+	free(layout->index.xs);
+	free(layout->index.ys);
+	free(layout->index.cells);
+	layout->index.valid = false;
+	layout->index.xs = layout->index.ys = NULL;
+	layout->index.cells = NULL;
+	layout->index.xs_len = layout->index.ys_len = 0;
+
+	size_t len = 0;
+	struct wlr_output_layout_output *l_output;
+	wl_list_for_each(l_output, &layout->outputs, link) {
+		output_layout_output_get_box(l_output, &l_output->box);
+		len++;
+	}
+
+	int *xs = calloc(2 * len + 1, sizeof(*xs));
+	int *ys = calloc(2 * len + 1, sizeof(*ys));
+	if (xs == NULL || ys == NULL) {
+		goto error;
+	}
+
+	size_t xs_len = 0, ys_len = 0;
+	wl_list_for_each(l_output, &layout->outputs, link) {
+		const struct wlr_box *box = &l_output->box;
+		if (wlr_box_empty(box)) {
+			continue;
+		}
+		xs[xs_len++] = box->x;
+		xs[xs_len++] = box->x + box->width;
+		ys[ys_len++] = box->y;
+		ys[ys_len++] = box->y + box->height;
+	}
+	xs_len = sort_unique(xs, xs_len);
+	ys_len = sort_unique(ys, ys_len);
+
+	struct wlr_output_layout_output **cells = NULL;
+	if (xs_len >= 2) {
+		size_t n_cols = xs_len - 1, n_rows = ys_len - 1;
+		if (n_cols > INDEX_MAX_CELLS / n_rows) {
+			goto error;
+		}
+		cells = calloc(n_cols * n_rows, sizeof(*cells));
+		if (cells == NULL) {
+			goto error;
+		}
+
+		wl_list_for_each(l_output, &layout->outputs, link) {
+			const struct wlr_box *box = &l_output->box;
+			if (wlr_box_empty(box)) {
+				continue;
+			}
+			size_t x1 = find_edge(xs, xs_len, box->x);
+			size_t x2 = find_edge(xs, xs_len, box->x + box->width);
+			size_t y1 = find_edge(ys, ys_len, box->y);
+			size_t y2 = find_edge(ys, ys_len, box->y + box->height);
+			for (size_t y = y1; y < y2; y++) {
+				for (size_t x = x1; x < x2; x++) {
+					struct wlr_output_layout_output **cell = &cells[y * n_cols + x];
+					if (*cell == NULL) {
+						*cell = l_output;
+					}
+				}
+			}
+		}
+	}
+
+	layout->index.xs = xs;
+	layout->index.ys = ys;
+	layout->index.xs_len = xs_len;
+	layout->index.ys_len = ys_len;
+	layout->index.cells = cells;
+	layout->index.valid = true;
+	return;
+
+error:
+	wlr_log(WLR_DEBUG, "Failed to build output layout index");
+	free(xs);
+	free(ys);
+}
+
+// Returns the first output containing the point, or NULL
+static struct wlr_output_layout_output *output_layout_index_lookup(
+		struct wlr_output_layout *layout, double lx, double ly) {
+	assert(layout->index.valid);
+	size_t x, y;
+	if (!find_interval(layout->index.xs, layout->index.xs_len, lx, &x) ||
+			!find_interval(layout->index.ys, layout->index.ys_len, ly, &y)) {
+		return NULL;
+	}
+	return layout->index.cells[y * (layout->index.xs_len - 1) + x];
+}
+
 /**
  * This must be called whenever the layout changes to reconfigure the auto
  * configured outputs and emit the `changed` event.
@@ -112,6 +253,8 @@ static void output_layout_reconfigure(struct wlr_output_layout *layout) {
 		max_x += output_box.width;
 	}
 
+	output_layout_rebuild_index(layout);
+
 	wl_signal_emit_mutable(&layout->events.change, layout);
 }
 
@@ -279,6 +422,12 @@ bool wlr_output_layout_intersects(struct wlr_output_layout *layout,
 
 struct wlr_output *wlr_output_layout_output_at(struct wlr_output_layout *layout,
 		double lx, double ly) {
+	if (layout->index.valid) {
+		struct wlr_output_layout_output *l_output =
+			output_layout_index_lookup(layout, lx, ly);
+		return l_output != NULL ? l_output->output : NULL;
+	}
+
 	struct wlr_output_layout_output *l_output;
 	wl_list_for_each(l_output, &layout->outputs, link) {
 		struct wlr_box output_box;
@@ -313,6 +462,26 @@ void wlr_output_layout_closest_point(struct wlr_output_layout *layout,
 		return;
 	}
 
+	// Fast path: the point is usually inside an output, in which case it's
+	// its own closest point
+	if (reference == NULL && layout->index.valid) {
+		struct wlr_output_layout_output *l_output =
+			output_layout_index_lookup(layout, lx, ly);
+		if (l_output != NULL) {
+			double x, y;
+			wlr_box_closest_point(&l_output->box, lx, ly, &x, &y);
+			if (x == lx && y == ly) {
+				if (dest_lx) {
+					*dest_lx = lx;
+				}
+				if (dest_ly) {
+					*dest_ly = ly;
+				}
+				return;
+			}
+		}
+	}
+
 	double min_x = lx, min_y = ly, min_distance = DBL_MAX;
 	struct wlr_output_layout_output *l_output;
 	wl_list_for_each(l_output, &layout->outputs, link) {
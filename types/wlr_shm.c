@@ -2,17 +2,22 @@
 #define _DEFAULT_SOURCE // for MAP_ANONYMOUS
 #include <assert.h>
 #include <drm_fourcc.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <wayland-server.h>
 #include <wlr/interfaces/wlr_buffer.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_shm.h>
 #include <wlr/util/log.h>
+#include "render/dmabuf.h"
 #include "render/pixel_format.h"
+#include "types/wlr_client_usage.h"
+#include "types/wlr_shm.h"
 
 #ifdef __STDC_NO_ATOMICS__
 #error "C11 atomics are required"
@@ -21,6 +26,13 @@
 #error "Lock-free C11 atomic pointers are required"
 #endif
 
+#if defined(__linux__) && !defined(F_GET_SEALS)
+#define F_GET_SEALS 1034
+#endif
+#if defined(__linux__) && !defined(F_SEAL_SHRINK)
+#define F_SEAL_SHRINK 0x0002
+#endif
+
 #define SHM_VERSION 1
 
 struct wlr_shm_pool {
@@ -29,6 +41,8 @@ struct wlr_shm_pool {
 	struct wl_list buffers; // wlr_shm_buffer.link
 	int fd;
 	struct wlr_shm_mapping *mapping;
+
+	struct wlr_client_usage_charge usage_charge;
 };
 
 /**
@@ -38,11 +52,18 @@ struct wlr_shm_pool {
  * re-map the FD with a larger size. However we might be at the same time still
  * accessing the old mapping (via wlr_buffer_begin_data_ptr_access()). We need
  * to keep the old mapping alive in that case.
+ *
+ * Each resize creates a new mapping, so whether the file can shrink under our
+ * feet is checked once per mapping rather than on every access.
  */
 struct wlr_shm_mapping {
 	void *data;
 	size_t size;
-	bool dropped; // false while a wlr_shm_pool references this mapping
+	// The file is sealed against shrinking and is large enough: accessing the
+	// mapping can never trigger SIGBUS
+	bool sealed;
+	// One reference for the wlr_shm_pool, one for each ongoing access
+	_Atomic size_t n_refs;
 };
 
 struct wlr_shm_sigbus_data {
@@ -60,8 +81,17 @@ struct wlr_shm_buffer {
 	struct wl_list link; // wlr_shm_pool.buffers
 	struct wl_resource *resource; // may be NULL
 
+	// udmabuf wrapping the buffer's memory, created on demand
+	int dmabuf_fd; // -1 if not created yet
+	uint32_t dmabuf_offset;
+	bool dmabuf_failed;
+	bool dmabuf_imported;
+
 	struct wl_listener release;
 
+	// Mapping used by the ongoing data pointer access, if any
+	struct wlr_shm_mapping *access_mapping;
+	bool access_sigbus;
 	struct wlr_shm_sigbus_data sigbus_data;
 };
 
@@ -97,6 +127,24 @@ static struct wlr_shm *shm_from_resource(struct wl_resource *resource) {
 	return wl_resource_get_user_data(resource);
 }
 
+static bool fd_is_sealed(int fd, size_t size) {
+#ifdef F_GET_SEALS
+	int seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+		return false;
+	}
+
+	// The client may have sealed the file before making it large enough
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		return false;
+	}
+	return st.st_size >= 0 && (uint64_t)st.st_size >= size;
+#else
+	return false;
+#endif
+}
+
 static struct wlr_shm_mapping *mapping_create(int fd, size_t size) {
 	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 	if (data == MAP_FAILED) {
@@ -112,36 +160,32 @@ static struct wlr_shm_mapping *mapping_create(int fd, size_t size) {
 
 	mapping->data = data;
 	mapping->size = size;
+	mapping->sealed = fd_is_sealed(fd, size);
+	atomic_init(&mapping->n_refs, 1);
 	return mapping;
 }
 
-static void mapping_consider_destroy(struct wlr_shm_mapping *mapping) {
-	if (!mapping->dropped) {
-		return;
-	}
-
-	for (struct wlr_shm_sigbus_data *cur = sigbus_data; cur != NULL; cur = cur->next) {
-		if (cur->mapping == mapping) {
-			return;
-		}
-	}
-
-	munmap(mapping->data, mapping->size);
-	free(mapping);
+static void mapping_ref(struct wlr_shm_mapping *mapping) {
+	atomic_fetch_add(&mapping->n_refs, 1);
 }
 
 /**
- * Indicate that this mapping is no longer used by its wlr_shm_pool owner.
+ * Release a reference to the mapping, either held by its wlr_shm_pool owner
+ * or by a data pointer access.
  *
  * May destroy the mapping.
  */
-static void mapping_drop(struct wlr_shm_mapping *mapping) {
+static void mapping_unref(struct wlr_shm_mapping *mapping) {
 	if (mapping == NULL) {
 		return;
 	}
 
-	mapping->dropped = true;
-	mapping_consider_destroy(mapping);
+	if (atomic_fetch_sub(&mapping->n_refs, 1) > 1) {
+		return;
+	}
+
+	munmap(mapping->data, mapping->size);
+	free(mapping);
 }
 
 static const struct wlr_buffer_resource_interface buffer_resource_interface = {
@@ -158,6 +202,9 @@ static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
 	wl_list_remove(&buffer->release.link);
 	wl_list_remove(&buffer->link);
 	pool_consider_destroy(buffer->pool);
+	if (buffer->dmabuf_fd >= 0) {
+		close(buffer->dmabuf_fd);
+	}
 	free(buffer);
 }
 
@@ -175,6 +222,62 @@ static bool buffer_get_shm(struct wlr_buffer *wlr_buffer,
 	return true;
 }
 
+static bool buffer_create_udmabuf(struct wlr_shm_buffer *buffer) {
+	long page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0) {
+		return false;
+	}
+
+	// udmabuf only deals with whole pages: wrap the pages covering the
+	// buffer and use the DMA-BUF plane offset for the remainder
+	uint64_t start = (uint64_t)buffer->offset -
+		(uint64_t)buffer->offset % page_size;
+	uint64_t end = (uint64_t)buffer->offset +
+		(uint64_t)buffer->stride * buffer->base.height;
+	end = (end + page_size - 1) / page_size * page_size;
+
+	int fd = dmabuf_create_from_memfd(buffer->pool->fd, start, end - start);
+	if (fd < 0) {
+		return false;
+	}
+
+	buffer->dmabuf_fd = fd;
+	buffer->dmabuf_offset = buffer->offset - start;
+	return true;
+}
+
+static bool buffer_get_dmabuf(struct wlr_buffer *wlr_buffer,
+		struct wlr_dmabuf_attributes *attribs) {
+	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+
+	if (!buffer->pool->shm->udmabuf_enabled || buffer->dmabuf_failed) {
+		return false;
+	}
+
+	struct wlr_shm *shm = buffer->pool->shm;
+	if (buffer->dmabuf_fd < 0) {
+		if (!buffer_create_udmabuf(buffer)) {
+			// Don't retry for every texture import, the renderers will
+			// fall back to uploading the data
+			buffer->dmabuf_failed = true;
+			shm->stats.udmabuf_failures++;
+			return false;
+		}
+	}
+
+	*attribs = (struct wlr_dmabuf_attributes){
+		.width = buffer->base.width,
+		.height = buffer->base.height,
+		.format = buffer->drm_format,
+		.modifier = DRM_FORMAT_MOD_LINEAR,
+		.n_planes = 1,
+		.offset[0] = buffer->dmabuf_offset,
+		.stride[0] = buffer->stride,
+		.fd[0] = buffer->dmabuf_fd,
+	};
+	return true;
+}
+
 static void handle_sigbus(int sig, siginfo_t *info, void *context) {
 	assert(sigbus_data != NULL);
 	struct sigaction prev_action = sigbus_data->prev_action;
@@ -213,10 +316,7 @@ reraise:
 	}
 }
 
-static bool buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
-		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
-	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
-
+static bool buffer_begin_sigbus_access(struct wlr_shm_buffer *buffer) {
 	if (!atomic_is_lock_free(&sigbus_data)) {
 		wlr_log(WLR_ERROR, "Lock-free atomic pointers are required");
 		return false;
@@ -238,24 +338,16 @@ static bool buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
 		prev_action = sigbus_data->prev_action;
 	}
 
-	struct wlr_shm_mapping *mapping = buffer->pool->mapping;
-
 	buffer->sigbus_data = (struct wlr_shm_sigbus_data){
-		.mapping = mapping,
+		.mapping = buffer->access_mapping,
 		.prev_action = prev_action,
 		.next = sigbus_data,
 	};
 	sigbus_data = &buffer->sigbus_data;
-
-	*data = (char *)mapping->data + buffer->offset;
-	*format = buffer->drm_format;
-	*stride = buffer->stride;
 	return true;
 }
 
-static void buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
-	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
-
+static void buffer_end_sigbus_access(struct wlr_shm_buffer *buffer) {
 	if (sigbus_data == &buffer->sigbus_data) {
 		sigbus_data = buffer->sigbus_data.next;
 	} else {
@@ -272,17 +364,92 @@ static void buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
 			wlr_log_errno(WLR_ERROR, "sigaction failed");
 		}
 	}
+}
+
+static bool buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+
+	struct wlr_shm_mapping *mapping = buffer->pool->mapping;
+	buffer->access_mapping = mapping;
+
+	// Files sealed against shrinking can't make us crash, so there's no need
+	// for the process-wide SIGBUS handler. This keeps such accesses free of
+	// global state, and thus usable from other threads.
+	buffer->access_sigbus = !mapping->sealed;
+	if (buffer->access_sigbus && !buffer_begin_sigbus_access(buffer)) {
+		buffer->access_mapping = NULL;
+		return false;
+	}
+	mapping_ref(mapping);
 
-	mapping_consider_destroy(buffer->sigbus_data.mapping);
+	*data = (char *)mapping->data + buffer->offset;
+	*format = buffer->drm_format;
+	*stride = buffer->stride;
+	return true;
+}
+
+static void buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+
+	if (buffer->access_sigbus) {
+		buffer_end_sigbus_access(buffer);
+	}
+
+	mapping_unref(buffer->access_mapping);
+	buffer->access_mapping = NULL;
 }
 
 static const struct wlr_buffer_impl buffer_impl = {
 	.destroy = buffer_destroy,
 	.get_shm = buffer_get_shm,
+	.get_dmabuf = buffer_get_dmabuf,
 	.begin_data_ptr_access = buffer_begin_data_ptr_access,
 	.end_data_ptr_access = buffer_end_data_ptr_access,
 };
 
+void shm_buffer_report_dmabuf_import(struct wlr_buffer *wlr_buffer,
+		bool success) {
+	if (wlr_buffer->impl != &buffer_impl) {
+		return;
+	}
+	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	struct wlr_shm *shm = buffer->pool->shm;
+
+	if (success) {
+		if (!buffer->dmabuf_imported) {
+			buffer->dmabuf_imported = true;
+			shm->stats.udmabuf_exports++;
+		}
+		return;
+	}
+
+	if (buffer->dmabuf_failed) {
+		return;
+	}
+
+	// Stop exposing the DMA-BUF, so that the buffer is consistently treated
+	// as a copy instead of being re-imported on every commit
+	buffer->dmabuf_failed = true;
+	if (buffer->dmabuf_imported) {
+		shm->stats.udmabuf_exports--;
+		buffer->dmabuf_imported = false;
+	}
+	shm->stats.udmabuf_failures++;
+	if (buffer->dmabuf_fd >= 0) {
+		close(buffer->dmabuf_fd);
+		buffer->dmabuf_fd = -1;
+	}
+}
+
+void shm_buffer_report_upload(struct wlr_buffer *wlr_buffer, uint64_t bytes) {
+	if (wlr_buffer->impl != &buffer_impl) {
+		return;
+	}
+	struct wlr_shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	buffer->pool->shm->stats.uploaded_bytes += bytes;
+}
+
 static void destroy_resource(struct wl_client *client,
 		struct wl_resource *resource) {
 	wl_resource_destroy(resource);
@@ -355,6 +522,7 @@ static void pool_handle_create_buffer(struct wl_client *client,
 	}
 
 	buffer->pool = pool;
+	buffer->dmabuf_fd = -1;
 	buffer->offset = offset;
 	buffer->stride = stride;
 	buffer->drm_format = drm_format;
@@ -379,6 +547,11 @@ static void pool_handle_resize(struct wl_client *client,
 		return;
 	}
 
+	if (!client_usage_charge_set(&pool->usage_charge, client, size)) {
+		wl_resource_post_no_memory(pool_resource);
+		return;
+	}
+
 	struct wlr_shm_mapping *mapping = mapping_create(pool->fd, size);
 	if (mapping == NULL) {
 		wl_resource_post_error(pool_resource, WL_SHM_ERROR_INVALID_FD,
@@ -386,7 +559,7 @@ static void pool_handle_resize(struct wl_client *client,
 		return;
 	}
 
-	mapping_drop(pool->mapping);
+	mapping_unref(pool->mapping);
 	pool->mapping = mapping;
 }
 
@@ -401,7 +574,8 @@ static void pool_consider_destroy(struct wlr_shm_pool *pool) {
 		return;
 	}
 
-	mapping_drop(pool->mapping);
+	client_usage_charge_finish(&pool->usage_charge);
+	mapping_unref(pool->mapping);
 	close(pool->fd);
 	free(pool);
 }
@@ -435,12 +609,18 @@ static void shm_handle_create_pool(struct wl_client *client,
 		goto error_mapping;
 	}
 
+	client_usage_charge_init(&pool->usage_charge, WLR_CLIENT_USAGE_SHM);
+	if (!client_usage_charge_set(&pool->usage_charge, client, size)) {
+		wl_resource_post_no_memory(shm_resource);
+		goto error_pool;
+	}
+
 	uint32_t version = wl_resource_get_version(shm_resource);
 	pool->resource =
 		wl_resource_create(client, &wl_shm_pool_interface, version, id);
 	if (pool->resource == NULL) {
 		wl_resource_post_no_memory(shm_resource);
-		goto error_pool;
+		goto error_charge;
 	}
 	wl_resource_set_implementation(pool->resource, &pool_impl, pool,
 		pool_handle_resource_destroy);
@@ -451,10 +631,12 @@ static void shm_handle_create_pool(struct wl_client *client,
 	wl_list_init(&pool->buffers);
 	return;
 
+error_charge:
+	client_usage_charge_finish(&pool->usage_charge);
 error_pool:
 	free(pool);
 error_mapping:
-	mapping_drop(mapping);
+	mapping_unref(mapping);
 error_fd:
 	close(fd);
 }
@@ -560,3 +742,7 @@ static bool shm_has_format(struct wlr_shm *shm, uint32_t shm_format) {
 	}
 	return false;
 }
+
+void wlr_shm_set_udmabuf_enabled(struct wlr_shm *shm, bool enabled) {
+	shm->udmabuf_enabled = enabled;
+}